@@ -0,0 +1,55 @@
+#pragma once
+
+#include <limits>
+#include <utility>
+#include <cfloat>
+
+#include "raycast.hpp"
+
+// Widens the slab test slightly so rounding can't cull a box the ray grazes, which matters for flat boxes
+const double AABB_ROBUST_SCALE = 1.0 + 3.0 * DBL_EPSILON;
+
+class AABB
+{
+public:
+	Coords min, max;
+
+	AABB()
+	{
+		double inf = std::numeric_limits<double>::infinity();
+		min = Coords(inf, inf, inf);
+		max = Coords(-inf, -inf, -inf);
+	}
+
+	AABB(Coords _min, Coords _max) : min(_min), max(_max) {}
+
+	void grow(const Coords& point);
+	void grow(const AABB& box);
+	Coords centre() const;
+	double surfaceArea() const;
+
+	// Slab test, tNear is set to the entry distance along the ray
+	inline bool hit(const Ray& ray, const Vec3& invDir, double tMax, double& tNear) const
+	{
+		double t0 = (min.x - ray.orig.x) * invDir.x;
+		double t1 = (max.x - ray.orig.x) * invDir.x;
+		double tEnter = t0 < t1 ? t0 : t1;
+		double tExit = t0 < t1 ? t1 : t0;
+
+		t0 = (min.y - ray.orig.y) * invDir.y;
+		t1 = (max.y - ray.orig.y) * invDir.y;
+		if (t0 > t1) std::swap(t0, t1);
+		if (t0 > tEnter) tEnter = t0;
+		if (t1 < tExit) tExit = t1;
+
+		t0 = (min.z - ray.orig.z) * invDir.z;
+		t1 = (max.z - ray.orig.z) * invDir.z;
+		if (t0 > t1) std::swap(t0, t1);
+		if (t0 > tEnter) tEnter = t0;
+		if (t1 < tExit) tExit = t1;
+
+		if (tExit * AABB_ROBUST_SCALE < tEnter || tExit < 0.0 || tEnter > tMax) return false;
+		tNear = tEnter;
+		return true;
+	}
+};
\ No newline at end of file
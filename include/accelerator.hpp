@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "bvh.hpp"
+#include "object.hpp"
+
+// Owns the BVH over every bounded object, unbounded shapes (planes) are tested linearly
+class Accelerator
+{
+public:
+	Accelerator(std::vector<Object>& _objects, int threads = 1, int width = 2);
+	// Uses a BVH built over the same objects earlier instead of building one
+	Accelerator(std::vector<Object>& _objects, BVH&& _bvh);
+
+	// Closest hit in [IMPRECISION_DELTA, tMax), narrows tMax. The surface of the hit isn't filled in
+	bool intersect(const Ray& ray, double& tMax, HitData& hitData, Object*& object);
+	// Any-hit query for shadow rays, tMax is in multiples of the ray direction
+	bool occluded(const Ray& ray, double tMax);
+
+	int width() { return bvh.width; }
+	int nodeCount() { return bvh.nodeCount(); }
+	double buildTime() { return bvh.buildTime; }
+
+private:
+	friend class SceneCache;
+
+	std::vector<Object>& objects;
+	std::vector<int> bounded; // Object index of each BVH primitive
+	std::vector<int> unbounded;
+	BVH bvh;
+
+	// Splits the objects into bounded and unbounded ones, returning the boxes of the bounded ones
+	std::vector<AABB> classify();
+};
\ No newline at end of file
@@ -2,39 +2,98 @@
 
 #include <cstdint>
 #include <string>
+#include <ostream>
 
-class Colour
+#include "vec3.hpp"
+
+// Same precision as Vec3, see vec3.hpp
+template<typename T> class VEC_ALIGN ColourT
 {
 public:
-	double r, g, b;
+	T r, g, b;
+
+	ColourT() : r(0), g(0), b(0) {}
+
+	ColourT(T _r, T _g, T _b) : r(_r), g(_g), b(_b) {}
+
+	inline ColourT operator*(T n) const
+	{
+		return ColourT(r * n, g * n, b * n);
+	}
+
+	inline void operator*=(T n)
+	{
+		r *= n;
+		g *= n;
+		b *= n;
+	}
+
+	inline ColourT operator*(const ColourT& n) const
+	{
+		return ColourT(r * n.r, g * n.g, b * n.b);
+	}
+
+	inline void operator*=(const ColourT& n)
+	{
+		r *= n.r;
+		g *= n.g;
+		b *= n.b;
+	}
+
+	inline ColourT operator/(T n) const
+	{
+		T inverse = T(1) / n;
+		return ColourT(r * inverse, g * inverse, b * inverse);
+	}
+
+	inline void operator/=(T n)
+	{
+		*this = *this / n;
+	}
+
+	inline void operator+=(const ColourT& n)
+	{
+		r += n.r;
+		g += n.g;
+		b += n.b;
+	}
 
-	Colour()
+	inline ColourT operator+(const ColourT& n) const
 	{
-		r = 0.0;
-		g = 0.0;
-		b = 0.0;
+		return ColourT(r + n.r, g + n.g, b + n.b);
 	}
 
-	Colour(double _r, double _g, double _b)
+	// Subtraction clamps at black
+	inline ColourT operator-(const ColourT& n) const
 	{
-		r = _r;
-		g = _g;
-		b = _b;
+		return ColourT(clampBlack(r - n.r), clampBlack(g - n.g), clampBlack(b - n.b));
 	}
 
-	Colour operator*(double n);
-	void operator*=(double n);
-	void operator*=(Colour n);
-	Colour operator/(double n);
-	void operator+=(Colour n);
-	Colour operator+(Colour b);
-	void operator/=(double n);
-	Colour operator-(Colour n);
-	void operator-=(Colour n);
-	Colour inverse();
-	Colour map(double(*fun)(double));
+	inline void operator-=(const ColourT& n)
+	{
+		*this = *this - n;
+	}
+
+	inline ColourT inverse() const
+	{
+		return ColourT(1 - r, 1 - g, 1 - b);
+	}
+
+	inline ColourT map(T(*fun)(T)) const
+	{
+		return ColourT(fun(r), fun(g), fun(b));
+	}
+
+private:
+	static inline T clampBlack(T n)
+	{
+		return n > 0 ? n : 0;
+	}
 };
 
+typedef ColourT<real> Colour;
+
+// 8-bit image for display, colours have to be tone mapped into [0, 1] first
 class Bitmap
 {
 public:
@@ -45,7 +104,7 @@ public:
 	{
 		width = _width;
 		height = _height;
-		data = new Colour[(uint64_t)(width) * height];
+		data = new uint8_t[(uint64_t)(width) * height * 3];
 	}
 
 	~Bitmap()
@@ -57,6 +116,12 @@ public:
 
 	bool save(std::string filename);
 
+	// Also used to write BMPs a few rows at a time, see imagewriter.hpp
+	static uint8_t channelByte(double value);
+	// Bytes in a row of pixels once padded to a multiple of 4
+	static unsigned int rowSize(unsigned int width);
+	static void writeHeader(std::ostream& file, unsigned int width, unsigned int height);
+
 private:
-	Colour* data;
+	uint8_t* data; // Blue, green and red for each pixel, the order BMP stores them in
 };
\ No newline at end of file
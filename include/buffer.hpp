@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+// Array that either owns its elements or borrows ones that live somewhere else, such as a mapped scene cache.
+// Borrowed elements are treated as read only, anything that changes the size copies them into owned storage first
+template<typename T> class Buffer
+{
+public:
+	Buffer() {}
+	Buffer(std::vector<T> _owned) : owned(std::move(_owned)) { sync(); }
+
+	Buffer(const Buffer& other) : owned(other.owned), borrowed(other.borrowed)
+	{
+		if (borrowed) lend(other.items, other.count);
+		else sync();
+	}
+
+	Buffer(Buffer&& other) : owned(std::move(other.owned)), borrowed(other.borrowed)
+	{
+		if (borrowed) lend(other.items, other.count);
+		else sync();
+		other.clear();
+	}
+
+	Buffer& operator=(const Buffer& other)
+	{
+		if (this == &other) return *this;
+		owned = other.owned;
+		borrowed = other.borrowed;
+		if (borrowed) lend(other.items, other.count);
+		else sync();
+		return *this;
+	}
+
+	Buffer& operator=(Buffer&& other)
+	{
+		if (this == &other) return *this;
+		owned = std::move(other.owned);
+		borrowed = other.borrowed;
+		if (borrowed) lend(other.items, other.count);
+		else sync();
+		other.clear();
+		return *this;
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	bool isBorrowed() const { return borrowed; }
+
+	T* data() { return items; }
+	const T* data() const { return items; }
+	T& operator[](size_t index) { return items[index]; }
+	const T& operator[](size_t index) const { return items[index]; }
+	T* begin() { return items; }
+	T* end() { return items + count; }
+	const T* begin() const { return items; }
+	const T* end() const { return items + count; }
+
+	void resize(size_t size)
+	{
+		own();
+		owned.resize(size);
+		sync();
+	}
+
+	void push_back(const T& item)
+	{
+		own();
+		owned.push_back(item);
+		sync();
+	}
+
+	void shrink_to_fit()
+	{
+		own();
+		owned.shrink_to_fit();
+		sync();
+	}
+
+	void clear()
+	{
+		std::vector<T>().swap(owned);
+		borrowed = false;
+		sync();
+	}
+
+	// Points the buffer at elements it doesn't own, they have to outlive it
+	void borrow(const T* _items, size_t _count)
+	{
+		std::vector<T>().swap(owned);
+		borrowed = true;
+		lend(_items, _count);
+	}
+
+private:
+	std::vector<T> owned;
+	T* items = nullptr;
+	size_t count = 0;
+	bool borrowed = false;
+
+	void lend(const T* _items, size_t _count)
+	{
+		items = const_cast<T*>(_items);
+		count = _count;
+	}
+
+	void own()
+	{
+		if (!borrowed) return;
+		owned.assign(items, items + count);
+		borrowed = false;
+	}
+
+	void sync()
+	{
+		items = owned.data();
+		count = owned.size();
+	}
+};
\ No newline at end of file
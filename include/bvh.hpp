@@ -0,0 +1,385 @@
+#pragma once
+
+#include <vector>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE
+#include <immintrin.h>
+#endif
+
+#include "aabb.hpp"
+#include "buffer.hpp"
+
+const int BVH_STACK_SIZE = 128;
+// Widens the float slab test slightly so rounding can't cull a box the ray grazes
+const float BVH_ROBUST_SCALE = 1.0f + 3.0f * FLT_EPSILON;
+
+class BVHNode
+{
+public:
+	AABB box;
+	int left; // Index of the first child, the second one is always left + 1
+	int first; // Index into BVH::indices of the first primitive in a leaf
+	int count; // Number of primitives in a leaf, 0 for interior nodes
+};
+
+// Collapsed node with N children, their bounds are kept as floats in structure-of-arrays
+// form so SSE/AVX can test all of them against a ray at once
+template<int N> class WideNode
+{
+public:
+	float minX[N];
+	float minY[N];
+	float minZ[N];
+	float maxX[N];
+	float maxY[N];
+	float maxZ[N];
+	int child[N]; // Wide node index, or index into BVH::indices of the first primitive for leaves
+	int count[N]; // Number of primitives for leaves, 0 for interior children
+	int used; // Children are packed at the front
+};
+
+class WideRay
+{
+public:
+	float orig[3];
+	float invDir[3];
+	// Entry/exit distances are off by at most this much from rounding the origin to float
+	float slack;
+
+	WideRay(const Ray& ray)
+	{
+		orig[0] = (float)ray.orig.x;
+		orig[1] = (float)ray.orig.y;
+		orig[2] = (float)ray.orig.z;
+		invDir[0] = (float)(1.0 / ray.dir.x);
+		invDir[1] = (float)(1.0 / ray.dir.y);
+		invDir[2] = (float)(1.0 / ray.dir.z);
+
+		slack = 0.0f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float shift = 2.0f * (float)std::abs((ray.orig[axis] - (double)orig[axis]) * invDir[axis]);
+			if (shift > slack) slack = shift;
+		}
+	}
+};
+
+class WideStackEntry
+{
+public:
+	int child;
+	int count;
+	float tNear;
+};
+
+// Tests every child box of a wide node, returns a bitmask of the ones hit and writes their entry distances
+template<int N> inline int intersectChildren(WideNode<N>& node, const WideRay& ray, float tMax, float* tNear)
+{
+	int mask = 0;
+	for (int i = 0; i < node.used; i++)
+	{
+		float t0 = (node.minX[i] - ray.orig[0]) * ray.invDir[0];
+		float t1 = (node.maxX[i] - ray.orig[0]) * ray.invDir[0];
+		float tEnter = t0 < t1 ? t0 : t1;
+		float tExit = t0 < t1 ? t1 : t0;
+		t0 = (node.minY[i] - ray.orig[1]) * ray.invDir[1];
+		t1 = (node.maxY[i] - ray.orig[1]) * ray.invDir[1];
+		tEnter = (t0 < t1 ? t0 : t1) > tEnter ? (t0 < t1 ? t0 : t1) : tEnter;
+		tExit = (t0 < t1 ? t1 : t0) < tExit ? (t0 < t1 ? t1 : t0) : tExit;
+		t0 = (node.minZ[i] - ray.orig[2]) * ray.invDir[2];
+		t1 = (node.maxZ[i] - ray.orig[2]) * ray.invDir[2];
+		tEnter = (t0 < t1 ? t0 : t1) > tEnter ? (t0 < t1 ? t0 : t1) : tEnter;
+		tExit = (t0 < t1 ? t1 : t0) < tExit ? (t0 < t1 ? t1 : t0) : tExit;
+		if (tEnter < 0.0f) tEnter = 0.0f;
+		if (tExit > tMax) tExit = tMax;
+		if (tEnter <= tExit * BVH_ROBUST_SCALE + ray.slack)
+		{
+			mask |= 1 << i;
+			tNear[i] = tEnter;
+		}
+	}
+	return mask;
+}
+
+#ifdef BVH_SSE
+// Four boxes starting at offset, the mask is relative to offset
+inline int intersectChildrenSSE(float* minX, float* minY, float* minZ, float* maxX, float* maxY, float* maxZ, const WideRay& ray, float tMax, float* tNear)
+{
+	__m128 origX = _mm_set1_ps(ray.orig[0]);
+	__m128 origY = _mm_set1_ps(ray.orig[1]);
+	__m128 origZ = _mm_set1_ps(ray.orig[2]);
+	__m128 invX = _mm_set1_ps(ray.invDir[0]);
+	__m128 invY = _mm_set1_ps(ray.invDir[1]);
+	__m128 invZ = _mm_set1_ps(ray.invDir[2]);
+
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(minX), origX), invX);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxX), origX), invX);
+	__m128 tEnter = _mm_max_ps(_mm_min_ps(t0, t1), _mm_setzero_ps());
+	__m128 tExit = _mm_min_ps(_mm_max_ps(t0, t1), _mm_set1_ps(tMax));
+	t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(minY), origY), invY);
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxY), origY), invY);
+	tEnter = _mm_max_ps(_mm_min_ps(t0, t1), tEnter);
+	tExit = _mm_min_ps(_mm_max_ps(t0, t1), tExit);
+	t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(minZ), origZ), invZ);
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxZ), origZ), invZ);
+	tEnter = _mm_max_ps(_mm_min_ps(t0, t1), tEnter);
+	tExit = _mm_min_ps(_mm_max_ps(t0, t1), tExit);
+
+	_mm_storeu_ps(tNear, tEnter);
+	return _mm_movemask_ps(_mm_cmple_ps(tEnter, _mm_add_ps(_mm_mul_ps(tExit, _mm_set1_ps(BVH_ROBUST_SCALE)), _mm_set1_ps(ray.slack))));
+}
+
+template<> inline int intersectChildren<4>(WideNode<4>& node, const WideRay& ray, float tMax, float* tNear)
+{
+	int mask = intersectChildrenSSE(node.minX, node.minY, node.minZ, node.maxX, node.maxY, node.maxZ, ray, tMax, tNear);
+	return mask & ((1 << node.used) - 1);
+}
+
+template<> inline int intersectChildren<8>(WideNode<8>& node, const WideRay& ray, float tMax, float* tNear)
+{
+#ifdef __AVX__
+	__m256 origX = _mm256_set1_ps(ray.orig[0]);
+	__m256 origY = _mm256_set1_ps(ray.orig[1]);
+	__m256 origZ = _mm256_set1_ps(ray.orig[2]);
+	__m256 invX = _mm256_set1_ps(ray.invDir[0]);
+	__m256 invY = _mm256_set1_ps(ray.invDir[1]);
+	__m256 invZ = _mm256_set1_ps(ray.invDir[2]);
+
+	__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minX), origX), invX);
+	__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxX), origX), invX);
+	__m256 tEnter = _mm256_max_ps(_mm256_min_ps(t0, t1), _mm256_setzero_ps());
+	__m256 tExit = _mm256_min_ps(_mm256_max_ps(t0, t1), _mm256_set1_ps(tMax));
+	t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minY), origY), invY);
+	t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxY), origY), invY);
+	tEnter = _mm256_max_ps(_mm256_min_ps(t0, t1), tEnter);
+	tExit = _mm256_min_ps(_mm256_max_ps(t0, t1), tExit);
+	t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minZ), origZ), invZ);
+	t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxZ), origZ), invZ);
+	tEnter = _mm256_max_ps(_mm256_min_ps(t0, t1), tEnter);
+	tExit = _mm256_min_ps(_mm256_max_ps(t0, t1), tExit);
+
+	_mm256_storeu_ps(tNear, tEnter);
+	int mask = _mm256_movemask_ps(_mm256_cmp_ps(tEnter, _mm256_add_ps(_mm256_mul_ps(tExit, _mm256_set1_ps(BVH_ROBUST_SCALE)), _mm256_set1_ps(ray.slack)), _CMP_LE_OQ));
+#else
+	int mask = intersectChildrenSSE(node.minX, node.minY, node.minZ, node.maxX, node.maxY, node.maxZ, ray, tMax, tNear);
+	mask |= intersectChildrenSSE(node.minX + 4, node.minY + 4, node.minZ + 4, node.maxX + 4, node.maxY + 4, node.maxZ + 4, ray, tMax, tNear + 4) << 4;
+#endif
+	return mask & ((1 << node.used) - 1);
+}
+#endif
+
+class BVH
+{
+public:
+	Buffer<BVHNode> nodes;
+	// Primitive indices in leaf order, leaves point to ranges of this
+	Buffer<int> indices;
+
+	// Children per node used for traversal, 2 traverses the binary tree, 4 and 8 the collapsed ones
+	int width = 2;
+	Buffer<WideNode<4>> nodes4;
+	Buffer<WideNode<8>> nodes8;
+
+	double buildTime = 0.0; // Milliseconds taken by the last build
+
+	// Binned SAH build, subtrees are handed out as tasks to the given number of threads
+	void build(std::vector<AABB>& boxes, int threads = 1);
+	// Collapses the binary tree into 4 or 8 wide nodes, the binary nodes are freed afterwards
+	void collapse(int _width);
+	int nodeCount();
+	// For trees read back from the scene cache: checks every child and primitive index the traversal for the
+	// current width follows is in range, that children come after their parent and the stack can hold the depth
+	bool validate(size_t primitives);
+
+	// Finds the closest primitive along the ray, visiting nearer children first.
+	// intersect(prim, tMax) must return true and shrink tMax when it finds a closer hit
+	template<typename F> bool closestHit(const Ray& ray, double& tMax, F intersect)
+	{
+		if (indices.empty()) return false;
+		if (width == 4) return closestHitWide(nodes4, ray, tMax, intersect);
+		if (width == 8) return closestHitWide(nodes8, ray, tMax, intersect);
+		return closestHitBinary(ray, tMax, intersect);
+	}
+
+	// Returns as soon as test(prim) reports a hit closer than tMax
+	template<typename F> bool anyHit(const Ray& ray, double tMax, F test)
+	{
+		if (indices.empty()) return false;
+		if (width == 4) return anyHitWide(nodes4, ray, tMax, test);
+		if (width == 8) return anyHitWide(nodes8, ray, tMax, test);
+		return anyHitBinary(ray, tMax, test);
+	}
+
+private:
+	template<int N> int collapseNode(int node, Buffer<WideNode<N>>& wideNodes);
+	template<int N> bool validateWide(const Buffer<WideNode<N>>& wideNodes);
+	bool validateLeaf(int first, int count);
+
+	template<typename F> bool closestHitBinary(const Ray& ray, double& tMax, F intersect)
+	{
+		if (nodes.empty()) return false;
+
+		Vec3 invDir(1.0 / ray.dir.x, 1.0 / ray.dir.y, 1.0 / ray.dir.z);
+		double tNear;
+		if (!nodes[0].box.hit(ray, invDir, tMax, tNear)) return false;
+
+		int stack[BVH_STACK_SIZE];
+		double stackNear[BVH_STACK_SIZE];
+		int stackPtr = 0;
+		int node = 0;
+		bool hit = false;
+
+		while (true)
+		{
+			BVHNode& current = nodes[node];
+			if (current.count > 0)
+			{
+				for (int i = current.first; i < current.first + current.count; i++)
+				{
+					if (intersect(indices[i], tMax)) hit = true;
+				}
+			}
+			else
+			{
+				double tLeft, tRight;
+				bool hitLeft = nodes[current.left].box.hit(ray, invDir, tMax, tLeft);
+				bool hitRight = nodes[current.left + 1].box.hit(ray, invDir, tMax, tRight);
+				if (hitLeft && hitRight)
+				{
+					int nearChild = tLeft <= tRight ? current.left : current.left + 1;
+					stack[stackPtr] = tLeft <= tRight ? current.left + 1 : current.left;
+					stackNear[stackPtr++] = tLeft <= tRight ? tRight : tLeft;
+					node = nearChild;
+					continue;
+				}
+				if (hitLeft || hitRight)
+				{
+					node = hitLeft ? current.left : current.left + 1;
+					continue;
+				}
+			}
+
+			// Skip anything that starts behind the closest hit found so far
+			do
+			{
+				if (stackPtr == 0) return hit;
+				stackPtr--;
+			} while (stackNear[stackPtr] > tMax);
+			node = stack[stackPtr];
+		}
+	}
+
+	template<typename F> bool anyHitBinary(const Ray& ray, double tMax, F test)
+	{
+		if (nodes.empty()) return false;
+
+		Vec3 invDir(1.0 / ray.dir.x, 1.0 / ray.dir.y, 1.0 / ray.dir.z);
+		double tNear;
+		if (!nodes[0].box.hit(ray, invDir, tMax, tNear)) return false;
+
+		int stack[BVH_STACK_SIZE];
+		int stackPtr = 0;
+		stack[stackPtr++] = 0;
+
+		while (stackPtr > 0)
+		{
+			BVHNode& current = nodes[stack[--stackPtr]];
+			if (current.count > 0)
+			{
+				for (int i = current.first; i < current.first + current.count; i++)
+				{
+					if (test(indices[i])) return true;
+				}
+				continue;
+			}
+			if (nodes[current.left].box.hit(ray, invDir, tMax, tNear)) stack[stackPtr++] = current.left;
+			if (nodes[current.left + 1].box.hit(ray, invDir, tMax, tNear)) stack[stackPtr++] = current.left + 1;
+		}
+		return false;
+	}
+
+	template<int N, typename F> bool closestHitWide(Buffer<WideNode<N>>& wideNodes, const Ray& ray, double& tMax, F intersect)
+	{
+		if (wideNodes.empty()) return false;
+
+		WideRay wideRay(ray);
+		WideStackEntry stack[BVH_STACK_SIZE * N];
+		int stackPtr = 0;
+		stack[stackPtr++] = WideStackEntry{ 0, 0, 0.0f };
+		bool hit = false;
+
+		while (stackPtr > 0)
+		{
+			WideStackEntry entry = stack[--stackPtr];
+			if (entry.tNear > tMax) continue;
+
+			if (entry.count > 0)
+			{
+				for (int i = entry.child; i < entry.child + entry.count; i++)
+				{
+					if (intersect(indices[i], tMax)) hit = true;
+				}
+				continue;
+			}
+
+			WideNode<N>& node = wideNodes[entry.child];
+			float tNear[N];
+			int mask = intersectChildren<N>(node, wideRay, (float)tMax, tNear);
+
+			// Insertion sort the children that were hit so the nearest one ends up on top of the stack
+			int hits[N];
+			int hitCount = 0;
+			for (int i = 0; i < N; i++)
+			{
+				if (!(mask & (1 << i))) continue;
+				int j = hitCount++;
+				while (j > 0 && tNear[hits[j - 1]] < tNear[i])
+				{
+					hits[j] = hits[j - 1];
+					j--;
+				}
+				hits[j] = i;
+			}
+			for (int i = 0; i < hitCount; i++)
+			{
+				int child = hits[i];
+				stack[stackPtr++] = WideStackEntry{ node.child[child], node.count[child], tNear[child] };
+			}
+		}
+		return hit;
+	}
+
+	template<int N, typename F> bool anyHitWide(Buffer<WideNode<N>>& wideNodes, const Ray& ray, double tMax, F test)
+	{
+		if (wideNodes.empty()) return false;
+
+		WideRay wideRay(ray);
+		int stack[BVH_STACK_SIZE * N];
+		int stackPtr = 0;
+		stack[stackPtr++] = 0;
+
+		while (stackPtr > 0)
+		{
+			WideNode<N>& node = wideNodes[stack[--stackPtr]];
+			float tNear[N];
+			int mask = intersectChildren<N>(node, wideRay, (float)tMax, tNear);
+			for (int i = 0; i < N; i++)
+			{
+				if (!(mask & (1 << i))) continue;
+				if (node.count[i] == 0)
+				{
+					stack[stackPtr++] = node.child[i];
+					continue;
+				}
+				for (int prim = node.child[i]; prim < node.child[i] + node.count[i]; prim++)
+				{
+					if (test(indices[prim])) return true;
+				}
+			}
+		}
+		return false;
+	}
+};
\ No newline at end of file
@@ -46,51 +46,52 @@ public:
 	void operator*=(double n);
 };
 
+template<typename T> Vec3T<T> Vec3T<T>::fromAngle(Angle angle)
+{
+	x = std::sin(angle.pitch) * std::cos(angle.yaw);
+	y = std::cos(angle.pitch);
+	z = std::sin(angle.pitch) * std::sin(angle.yaw);
+
+	return *this;
+}
+
 class Camera
 {
 public:
 	Coords pos, lookingAt;
-	Coords viewplaneTL, viewplaneBR, viewplaneTR, viewplaneBL;
 	double fovHoriz, fovVert;
+	// Orthonormal basis, up is kept as close to world +y as the view direction allows
+	Vec3 forward, right, up;
+	// Top left corner of the image plane at unit distance, and the step to the next pixel across and down
+	Vec3 topLeft, pixelDeltaX, pixelDeltaY;
 
 	Camera(Coords coords, Coords _lookingAt, int FOV, int width, int height)
 	{
 		pos = coords;
 		lookingAt = _lookingAt;
 
+		forward = (lookingAt - pos).unit();
+		Vec3 worldUp(0, 1, 0);
+		// Looking straight up or down leaves the world up vector useless for the cross product
+		if (std::fabs(forward.dot(worldUp)) > 0.999999) worldUp = Vec3(0, 0, 1);
+		right = worldUp.cross(forward).unit();
+		up = forward.cross(right);
+
+		// Square pixels, so the vertical extent follows from the horizontal FOV and the aspect ratio
+		double halfWidth = std::tan(toRads(FOV) / 2);
+		double halfHeight = halfWidth * height / width;
 		fovHoriz = FOV;
-		fovVert = (double)FOV * ((double)height / width); // Image aspect ratio = screen aspect ratio
-
-		Angle lookingAngle = Angle().fromVec3(lookingAt - pos);
-		// Get the angle to the top left of the viewplane
-		Angle topLeft = lookingAngle.delta(fovHoriz / 2, -fovVert / 2) / 180.0 * pi;
-
-		Angle botRight = lookingAngle.delta(-fovHoriz / 2, fovVert / 2) / 180.0 * pi;
-		Angle topRight = lookingAngle.delta(-fovHoriz / 2, -fovVert / 2) / 180.0 * pi;
-		Angle botLeft = lookingAngle.delta(fovHoriz / 2, fovVert / 2) / 180.0 * pi;
-
-		Angle half = Angle(fovHoriz, fovVert) / 2;
-		half = half / 180.0 * pi;
-		// Hypotenuses of the triangles with the distance from the camera to the viewplane center
-		// and half the width/height of the viewplane
-		double distToViewplaneEdgeHoriz = ((double)width / 2) / std::sin(half.yaw);
-		double distToViewplaneEdgeVert = ((double)height / 2) / std::sin(half.pitch);
-		// Relative coords to the center of the vertical and horizontal edges of the viewplane
-		Vec3 toVertLine = Vec3(0, distToViewplaneEdgeVert * std::sin(half.pitch), distToViewplaneEdgeVert * std::cos(half.pitch));
-		Vec3 toHorizLine = Vec3(0, distToViewplaneEdgeHoriz * std::sin(half.yaw), distToViewplaneEdgeHoriz * std::cos(half.yaw));
-		// Distance from the camera to the corner of the viewplane
-		double toCorner = (toVertLine + toHorizLine).length();
-
-		// Unit vector from the camera to the viewplane corner
-		Vec3 unit = Vec3(std::sin(topLeft.pitch) * std::cos(topLeft.yaw), cos(topLeft.pitch), sin(topLeft.pitch) * sin(topLeft.yaw));
-		// Multiplied by the distance to get the coordinates
-		viewplaneTL = unit * toCorner;
-		
-		unit = Vec3(std::sin(topRight.pitch) * std::cos(topRight.yaw), cos(topRight.pitch), sin(topRight.pitch) * sin(topRight.yaw));
-		viewplaneTR = unit * toCorner;
-		unit = Vec3(std::sin(botLeft.pitch) * std::cos(botLeft.yaw), cos(botLeft.pitch), sin(botLeft.pitch) * sin(botLeft.yaw));
-		viewplaneBL = unit * toCorner;
-		unit = Vec3(std::sin(botRight.pitch) * std::cos(botRight.yaw), cos(botRight.pitch), sin(botRight.pitch) * sin(botRight.yaw));
-		viewplaneBR = unit * toCorner;
+		fovVert = toDegs(2 * std::atan(halfHeight));
+
+		pixelDeltaX = right * (2 * halfWidth / width);
+		pixelDeltaY = -up * (2 * halfHeight / height);
+		topLeft = forward - right * halfWidth + up * halfHeight;
+	}
+
+	// Unit direction through the point (x, y) of the image in pixels, (0.5, 0.5) is the centre of the top left pixel
+	inline Vec3 rayDir(double x, double y) const
+	{
+		Vec3 dir = topLeft + pixelDeltaX * x + pixelDeltaY * y;
+		return dir / dir.length();
 	}
 };
\ No newline at end of file
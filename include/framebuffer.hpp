@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "bitmap.hpp"
+#include "tonemap.hpp"
+
+// Running statistics of a pixel's sample luminance, Welford's mean and sum of squared differences
+class PixelStats
+{
+public:
+	uint32_t samples;
+	float mean, squaredDiffs;
+
+	// Half width of the 95% confidence interval, scaled by the square root's slope at the mean to say how far the
+	// pixel could visibly be out once brightness corrected. Infinite until there are two samples to go on
+	double error() const;
+};
+
+// Float sums of every sample taken for each pixel, so render passes can keep adding to the same image.
+// Averages are linear and unclamped, they only get tone mapped on the way to a Bitmap
+class Framebuffer
+{
+public:
+	int width, height;
+
+	// Per pixel stats are only needed to stop pixels early or measure noise. Without them every pixel has the same
+	// sample count, set after each pass, and the framebuffer takes 12 bytes a pixel instead of 24
+	Framebuffer(int _width, int _height, bool _perPixelStats = true);
+
+	PixelStats stats(int x, int y) const { return perPixelStats ? pixelStats[(size_t)y * width + x] : PixelStats{ samples, 0.0f, 0.0f }; }
+	// Adds the sum of a pixel's new samples, stats already counts them. Each pixel must only be added to by one thread at a time
+	void add(int x, int y, const Colour& sum, const PixelStats& stats);
+	// Samples every pixel has so far, for framebuffers without per pixel stats
+	void setSamples(uint32_t _samples) { samples = _samples; }
+	Colour average(int x, int y) const;
+
+	// Mean error over the pixels that have one, infinite before any do or without per pixel stats
+	double noise() const;
+	void toBitmap(Bitmap& image, const ToneMapper& toneMapper) const;
+
+	// Lossless HDR output of the averages. PFM is the Portable Float Map, EXR a single part scanline OpenEXR file
+	// with 32-bit float channels, stored as is or with its RLE compression
+	bool savePFM(const std::string& filename) const;
+	bool saveEXR(const std::string& filename, bool rle) const;
+
+private:
+	bool perPixelStats;
+	uint32_t samples = 0;
+	std::vector<float> sums; // Red, green and blue for each pixel
+	std::vector<PixelStats> pixelStats;
+};
\ No newline at end of file
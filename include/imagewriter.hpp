@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <cstdint>
+
+#include "bitmap.hpp"
+#include "tonemap.hpp"
+
+// Writes an image as the render finishes it, without ever holding the whole frame. Rows of tiles are buffered per
+// band of tiles, and once every tile in a band is done its rows are converted and written straight to their place
+// in the file, bottom-up for BMP and PFM and top-down for PPM, so memory only has to cover the bands in progress
+class StreamingImageWriter
+{
+public:
+	enum Format
+	{
+		BMP, // 8-bit, tone mapped
+		PPM, // 8-bit binary P6, tone mapped
+		PFM // Linear 32-bit float
+	};
+
+	StreamingImageWriter(int _width, int _height, int _bandHeight, const ToneMapper& _toneMapper)
+		: width(_width), height(_height), bandHeight(_bandHeight), toneMapper(_toneMapper) {}
+
+	// Picks the format from the extension, false if it can't be streamed
+	static bool formatFor(const std::string& filename, Format& format);
+
+	// Writes the header, false if the file can't be opened
+	bool open(const std::string& filename, Format _format);
+	// Adds finished pixels from one row of a tile. Safe to call from every render thread at once
+	void writeRow(int x, int y, int count, const Colour* pixels);
+	// False if anything couldn't be written or some of the image never arrived
+	bool close();
+
+	// Most rows held in memory at once
+	int peakRows() { return peakBands * bandHeight; }
+
+private:
+	class Band
+	{
+	public:
+		std::vector<float> pixels; // Red, green and blue
+		int64_t pixelsLeft;
+	};
+
+	int width, height, bandHeight;
+	ToneMapper toneMapper;
+	Format format;
+	std::string path;
+	std::ofstream file;
+	std::streamoff headerSize = 0;
+
+	std::mutex bandMutex;
+	std::map<int, Band> bands;
+	int peakBands = 0;
+	// Bands are written by whichever thread finishes them, one at a time
+	std::mutex fileMutex;
+
+	void writeBand(int band, const Band& data);
+};
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only view of a whole file mapped into memory, pages are read in by the OS as they are touched
+class MappedFile
+{
+public:
+	const char* data = nullptr;
+	size_t size = 0;
+
+	MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Empty files can't be mapped and count as failing to open
+	bool isOpen() const { return data != nullptr; }
+
+private:
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
\ No newline at end of file
@@ -1,34 +1,63 @@
-#include <random>
+#pragma once
 
 #include "raycast.hpp"
 
 class Shape;
 
-Vec3 randInUnitSphere();
+Vec3 randInUnitSphere(Sampler& sampler);
+// Direction about the normal with probability proportional to its cosine, pdf is cos / pi
+Vec3 cosineHemisphere(const Vec3& normal, Sampler& sampler, double& pdf);
 
-inline Vec3 reflectVec(Vec3 ray, Vec3 normal)
+inline Vec3 reflectVec(const Vec3& ray, const Vec3& normal)
 {
 	return ray - normal * normal.dot(ray) * 2.0;
 }
 
+// Bounce picked by a material, pdf is per unit solid angle and 0 for specular (or fuzzed specular) bounces without a usable density
+class BSDFSample
+{
+public:
+	Ray ray;
+	double pdf;
+
+	BSDFSample(const Ray& _ray, double _pdf) : ray(_ray), pdf(_pdf) {}
+};
+
 class Material
 {
 public:
-	virtual Ray bounce(Ray ray, HitData& hit) = 0;
+	virtual ~Material() {}
+
+	virtual BSDFSample bounce(const Ray& ray, const HitData& hit, Sampler& sampler) = 0;
+	// BSDF times cosine for light arriving along dir (pointing away from the surface) and the pdf bounce() would have
+	// picked dir with. Specular materials can't be lit this way and leave both at 0
+	virtual double evaluate(const Ray& ray, const HitData& hit, const Vec3& dir, double& pdf)
+	{
+		pdf = 0.0;
+		return 0.0;
+	}
 	virtual double attenuation() = 0;
 };
 
 class MatDiffuse : public Material
 {
 public:
-	const double scatter = 1.0;
 	double attenuation() override { return 0.8; }
 
-	Ray bounce(Ray ray, HitData& hit) override
+	// Lambertian, the cosine in the pdf cancels the one in the rendering equation
+	BSDFSample bounce(const Ray& ray, const HitData& hit, Sampler& sampler) override
 	{
-		return Ray(hit.pos, randInUnitSphere().unit() * scatter + hit.normal);
+		double pdf;
+		Vec3 dir = cosineHemisphere(hit.normal, sampler, pdf);
+		return BSDFSample(Ray(hit.pos, dir), pdf);
+	}
+
+	double evaluate(const Ray& ray, const HitData& hit, const Vec3& dir, double& pdf) override
+	{
+		double cosine = std::fmax(0.0, (double)hit.normal.dot(dir));
+		pdf = cosine / pi;
+		return cosine / pi;
 	}
-	
 };
 
 class MatMetal : public Material
@@ -36,45 +65,47 @@ class MatMetal : public Material
 public:
 	double attenuation() override { return 0.6; };
 
-	Ray bounce(Ray ray, HitData& hit) override
+	BSDFSample bounce(const Ray& ray, const HitData& hit, Sampler& sampler) override
 	{
-		return Ray(hit.pos, reflectVec(ray.dir, hit.normal));
+		return BSDFSample(Ray(hit.pos, reflectVec(ray.dir, hit.normal)), 0.0);
 	}
 };
 
 class MatMetalFuzz : public Material
 {
 public:
+	double perturbation;
+
+	MatMetalFuzz(double _perturbation = 0.2) : perturbation(_perturbation) {}
+
 	double attenuation() override { return 0.65; }
-	const double perturbation = 0.2;
-	Ray bounce(Ray ray, HitData& hit) override
+	BSDFSample bounce(const Ray& ray, const HitData& hit, Sampler& sampler) override
 	{
-		return Ray(hit.pos, reflectVec(ray.dir, hit.normal) + randInUnitSphere() * perturbation);
+		return BSDFSample(Ray(hit.pos, reflectVec(ray.dir, hit.normal) + randInUnitSphere(sampler) * perturbation), 0.0);
 	}
 };
 
 class MatGlass : public Material
 {
 public:
-	const double refractiveIndex = 1.33;
+	double refractiveIndex;
+
+	MatGlass(double _refractiveIndex = 1.33) : refractiveIndex(_refractiveIndex) {}
+
 	double attenuation() override { return 0.0; }
-	Ray bounce(Ray ray, HitData& hit) override
+	BSDFSample bounce(const Ray& ray, const HitData& hit, Sampler& sampler) override
 	{
-		std::random_device rd;
-		std::mt19937 gen(rd());
-		std::uniform_real_distribution<> dis(0.0, 1.0);
-
 		double ratio = hit.isFront ? (1.0 / refractiveIndex) : refractiveIndex;
 		double cosTheta = std::fmin((-ray.dir).dot(hit.normal), 1.0);
 		double sinTheta = std::sqrt(1.0 - cosTheta * cosTheta);
-		if (ratio * sinTheta > 1.0 || reflectance(cosTheta, ratio) > dis(gen))
+		if (ratio * sinTheta > 1.0 || reflectance(cosTheta, ratio) > sampler.next1D())
 		{
-			return Ray(hit.pos, reflectVec(ray.dir, hit.normal));
+			return BSDFSample(Ray(hit.pos, reflectVec(ray.dir, hit.normal)), 0.0);
 		}
 		Vec3 perpendicular = (ray.dir + hit.normal * cosTheta) * ratio;
-		Vec3 parallel = hit.normal * -std::sqrt(std::fabs(1.0 - std::pow(perpendicular.length(), 2)));
+		Vec3 parallel = hit.normal * -std::sqrt(std::fabs(1.0 - perpendicular.lengthSquared()));
 		Vec3 refracted = (perpendicular + parallel).unit();
-		return Ray(hit.pos, refracted);
+		return BSDFSample(Ray(hit.pos, refracted), 0.0);
 	}
 
 private:
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "shapes.hpp"
+#include "bvh.hpp"
+
+// Per-ray setup for the watertight triangle test, shared by every triangle the ray is tested against
+class TriangleRay
+{
+public:
+	int kx, ky, kz; // Axes permuted so the ray travels along kz
+	double sx, sy, sz; // Shear taking the ray direction to (0, 0, 1)
+
+	TriangleRay(const Ray& ray);
+};
+
+// Indexed triangle mesh, the whole mesh is a single shape with its own BVH over the triangles
+class TriangleMesh : public Shape
+{
+public:
+	Buffer<Coords> positions;
+	// One per position, left empty to shade with the flat face normal
+	Buffer<Vec3> normals;
+	// Three positions per triangle, counter-clockwise seen from the front
+	Buffer<uint32_t> indices;
+
+	TriangleMesh() {}
+	TriangleMesh(std::vector<Coords> _positions, std::vector<Vec3> _normals, std::vector<uint32_t> _indices);
+
+	// Scales about the origin then moves every position, call before build()
+	void transform(double scale, const Vec3& offset);
+	// Must be called once the arrays are filled in and before the mesh is rendered
+	void build(int threads = 1, int width = 2);
+	int triangleCount() const { return (int)(indices.size() / 3); }
+
+	bool hit(const Ray& ray, double tMin, double& tMax, HitData& data) override;
+	void surface(const Ray& ray, HitData& data) override;
+	bool occludes(const Ray& ray, double tMin, double tMax) override;
+	bool bounds(AABB& box) override;
+
+private:
+	friend class SceneCache;
+
+	BVH bvh;
+	AABB box;
+
+	bool intersectTriangle(const Ray& ray, const TriangleRay& triRay, int tri, double tMin, double& tMax, double& u, double& v);
+};
\ No newline at end of file
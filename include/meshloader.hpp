@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#include "mesh.hpp"
+
+class MeshLoadStats
+{
+public:
+	size_t bytes = 0; // Size of the file
+	double loadTime = 0.0; // Milliseconds from opening the file to the mesh arrays being filled
+
+	double throughput() const { return loadTime > 0.0 ? (bytes / 1e6) / (loadTime / 1000.0) : 0.0; }
+};
+
+// Loads a Wavefront OBJ or binary PLY file, picked by its extension. The file is memory mapped and
+// split into chunks that are parsed in parallel straight into the mesh arrays.
+// Prints the reason and returns false if the file can't be loaded, build() still has to be called on the mesh
+bool loadMesh(const std::string& path, TriangleMesh& mesh, int threads, MeshLoadStats& stats);
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <random>
 
 #include "camera.hpp"
+#include "bitmap.hpp"
 
 class Material;
 class Shape;
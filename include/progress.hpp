@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <ostream>
+
+const int BLOCK_UNRENDERED = -1;
+const int BLOCK_RENDERED = -2;
+
+// Written by the render threads, read by whichever reporter is drawing
+class RenderProgress
+{
+public:
+	int numBlocksX, numBlocksY, numBlocks;
+	int totalRows;
+
+	// Thread ID rendering each block, or one of the states above
+	std::atomic<int>* blockStates;
+	// Rows of each block still to be rendered, split tiles can be finished by several threads
+	std::atomic<int>* blockRowsLeft;
+	std::atomic<int> blocksDone;
+	std::atomic<int> rowsDone;
+	std::atomic<uint64_t> pixels;
+	std::atomic<uint64_t> rays;
+	// Camera paths and the rays along them, not counting shadow rays
+	std::atomic<uint64_t> paths, pathSegments;
+	std::atomic<int> finishedThreads;
+
+	RenderProgress(int width, int height, int blockSize);
+	~RenderProgress();
+
+	void startBlock(int block, int thread);
+	void finishRow(int block, int rowPixels, uint64_t rowRays, uint64_t rowPaths, uint64_t rowSegments);
+	double averagePathLength();
+	// Each path is one sample, so this shows how much adaptive sampling saved
+	double averageSamples();
+};
+
+class ProgressReporter
+{
+public:
+	virtual ~ProgressReporter() {}
+
+	virtual void begin(RenderProgress& progress) {}
+	// Called regularly from the main thread while rendering, reporters decide themselves how often to output
+	virtual void update(RenderProgress& progress) = 0;
+	virtual void end(RenderProgress& progress, std::vector<double>& idleTimes) = 0;
+	// After each pass of a progressive render, with the samples per pixel so far and the frame's average error
+	virtual void pass(int number, int samples, double noise, double elapsed) = 0;
+};
+
+// Interactive grid of blocks drawn with conmanip cursor positioning
+class ConsoleGridReporter : public ProgressReporter
+{
+public:
+	void begin(RenderProgress& progress) override;
+	void update(RenderProgress& progress) override;
+	void end(RenderProgress& progress, std::vector<double>& idleTimes) override;
+	void pass(int number, int samples, double noise, double elapsed) override;
+
+private:
+	int conOffsetX, conOffsetY;
+	std::vector<int> drawnStates;
+};
+
+// One JSON object per line at most every interval seconds, for logs on batch nodes. The lines go to the given
+// buffer, main points std::cout at stderr so other messages can't end up between them
+class HeadlessReporter : public ProgressReporter
+{
+public:
+	HeadlessReporter(double _interval, std::streambuf* output) : interval(_interval), out(output) {}
+
+	void begin(RenderProgress& progress) override;
+	void update(RenderProgress& progress) override;
+	void end(RenderProgress& progress, std::vector<double>& idleTimes) override;
+	void pass(int number, int samples, double noise, double elapsed) override;
+
+private:
+	double interval;
+	std::ostream out;
+	std::chrono::steady_clock::time_point start, lastReport;
+
+	void report(RenderProgress& progress, const char* event);
+};
\ No newline at end of file
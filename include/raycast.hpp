@@ -1,18 +1,29 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 
 #include "camera.hpp"
 #include "bitmap.hpp"
 #include "object.hpp"
+#include "sampler.hpp"
 
 extern int maxBounces;
+// Bounces every path gets before Russian roulette can end it
+extern int rouletteDepth;
+// Camera, bounce and shadow rays cast by the calling thread
+extern thread_local uint64_t raysTraced;
+// Camera and bounce rays only, for the average path length
+extern thread_local uint64_t pathSegments;
 const double IMPRECISION_DELTA = 0.000001;
 
 typedef struct {
+	double t; // Distance along the ray in multiples of its direction
 	Coords pos;
 	Vec3 normal;
 	bool isFront;
+	int prim; // Triangle index and barycentrics, only set by meshes
+	double u, v;
 } HitData;
 
 class Ray
@@ -21,11 +32,10 @@ public:
 	Coords orig;
 	Vec3 dir;
 
-	Ray(Coords _orig, Vec3 _dir)
-	{
-		orig = _orig;
-		dir = _dir;
-	}
+	Ray(const Coords& _orig, const Vec3& _dir) : orig(_orig), dir(_dir) {}
 };
 
-Colour raycast(Ray ray, std::vector<Object>& objects, std::vector<Light>& lights, int depth);
\ No newline at end of file
+class Accelerator;
+
+// Follows a camera ray for up to maxBounces bounces, returning the light it carries back
+Colour raycast(const Ray& cameraRay, Accelerator& accel, std::vector<Light>& lights, Sampler& sampler);
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+
+// Source of the random numbers for a camera sample. Every number is derived from the frame seed, pixel, sample
+// and bounce, never from the thread, so a sample draws the same numbers whichever thread renders it
+class Sampler
+{
+public:
+	Sampler(uint64_t _frameSeed) : frameSeed(_frameSeed) {}
+	virtual ~Sampler() {}
+
+	// Called before the camera jitter of each sample
+	virtual void startPixelSample(int x, int y, int sample) = 0;
+	// Every bounce gets its own dimensions, so a rejection loop taking more numbers at one bounce doesn't shift the next
+	virtual void startBounce(int bounce) = 0;
+
+	// Uniform in [0, 1)
+	virtual double next1D() = 0;
+	// Two numbers meant to be used together, such as a point on a disk, so samplers can stratify them as a pair
+	virtual void next2D(double& u, double& v)
+	{
+		u = next1D();
+		v = next1D();
+	}
+
+	double uniform(double min, double max)
+	{
+		return min + (max - min) * next1D();
+	}
+
+protected:
+	uint64_t frameSeed;
+
+	// SplitMix64 finaliser, spreads neighbouring pixel indices over the whole seed space
+	static uint64_t mix(uint64_t value)
+	{
+		value += 0x9e3779b97f4a7c15ULL;
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+		return value ^ (value >> 31);
+	}
+};
+
+// PCG32 generator (https://www.pcg-random.org), 16 bytes of state so each thread can keep its own
+class PCGSampler : public Sampler
+{
+public:
+	PCGSampler(uint64_t _frameSeed = 0) : Sampler(_frameSeed)
+	{
+		seed(mix(frameSeed), 0);
+	}
+
+	void seed(uint64_t initState, uint64_t sequence)
+	{
+		state = 0;
+		inc = (sequence << 1) | 1;
+		nextUInt();
+		state += initState;
+		nextUInt();
+	}
+
+	void startPixelSample(int x, int y, int sample) override
+	{
+		uint64_t pixel = ((uint64_t)(uint32_t)y << 32) | (uint32_t)x;
+		sampleKey = mix(mix(frameSeed ^ mix(pixel)) ^ (uint32_t)sample);
+		startDimension(0);
+	}
+
+	void startBounce(int bounce) override
+	{
+		startDimension(bounce + 1);
+	}
+
+	uint32_t nextUInt()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + inc;
+		uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		uint32_t rot = (uint32_t)(old >> 59);
+		return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+	}
+
+	double next1D() override
+	{
+		return nextUInt() * (1.0 / 4294967296.0);
+	}
+
+private:
+	uint64_t state, inc;
+	uint64_t sampleKey = 0;
+
+	void startDimension(int dimension)
+	{
+		uint64_t key = mix(sampleKey ^ (uint32_t)dimension);
+		seed(key, mix(key ^ sampleKey));
+	}
+};
+
+// Owen-scrambled Sobol points using Burley's hash-based scrambling ("Practical Hash-based Owen Scrambling", 2020).
+// Numbers are handed out in pairs of dimensions that each have their own scramble and sample order, so every pair
+// is a stratified (0, 2)-sequence and there is no limit on how many dimensions a path takes.
+// With zOrder the sample index continues across pixels along a scrambled Morton curve (Ahmed and Wonka, "Screen-Space
+// Blue-Noise Diffusion of Monte Carlo Sampling Error via Hierarchical Ordering of Pixels", 2020), so neighbouring pixels
+// share one sequence and their error comes out as blue noise
+class SobolSampler : public Sampler
+{
+public:
+	// samplesPerPixel only matters with zOrder, it is rounded up to a power of two to leave room for each pixel's samples
+	SobolSampler(uint64_t _frameSeed, bool _zOrder, int samplesPerPixel);
+
+	void startPixelSample(int x, int y, int sample) override;
+	void startBounce(int bounce) override;
+	double next1D() override;
+	// Skips to the start of a pair if one number has been taken from it already
+	void next2D(double& u, double& v) override;
+
+private:
+	bool zOrder;
+	int sampleBits;
+	uint32_t index;
+	// Scrambles for the current pixel, the current bounce and the pair of dimensions in use
+	uint64_t pixelSeed, bounceSeed;
+	uint32_t pairSeed;
+	uint32_t pairIndex;
+	int dimension;
+
+	void startPair();
+};
\ No newline at end of file
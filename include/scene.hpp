@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "object.hpp"
+#include "accelerator.hpp"
+#include "json.h"
+
+class Shape;
+class Material;
+class MappedFile;
+
+// Owns every shape, material and object that gets rendered, along with the BVH over them
+class Scene
+{
+public:
+	std::vector<Object> objects;
+	std::vector<Light> lights;
+
+	// The built-in materials "diffuse", "metal", "metal_fuzz" and "glass" are always available
+	Scene();
+	~Scene();
+
+	// Adds everything in the "materials", "objects", "meshes" and "lights" sections of the config and
+	// builds the BVH. Entries that can't be used are reported and skipped.
+	// With a cache path the scene is mapped from the cache when it matches the config, and written to it when it doesn't
+	void load(const nlohmann::json& config, int threads, int bvhWidth, const std::string& cachePath = "");
+
+	Accelerator& accelerator() { return *accel; }
+	// True when the scene and its BVH were mapped from the cache instead of built
+	bool fromCache() { return cacheFile != nullptr; }
+
+private:
+	friend class SceneCache;
+
+	std::vector<std::unique_ptr<Shape>> shapes;
+	std::map<std::string, std::unique_ptr<Material>> materials;
+	std::unique_ptr<Accelerator> accel;
+	// Meshes and BVHs loaded from the cache point into this mapping
+	std::unique_ptr<MappedFile> cacheFile;
+
+	void loadMaterials(const nlohmann::json& section);
+	void loadObjects(const nlohmann::json& section);
+	void loadMeshes(const nlohmann::json& section, int threads, int bvhWidth);
+	void loadLights(const nlohmann::json& section);
+
+	// Falls back to diffuse for names that don't exist
+	Material* material(const std::string& name);
+};
\ No newline at end of file
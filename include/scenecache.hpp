@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "json.h"
+
+class Scene;
+class TriangleMesh;
+
+const uint32_t SCENE_CACHE_VERSION = 1;
+
+// Binary snapshot of a loaded scene. Materials, shapes, mesh arrays and every BVH are written out flat,
+// so a later run can map the file and point the scene straight at it instead of parsing and building again
+class SceneCache
+{
+public:
+	// Covers the scene sections of the config, the BVH width and the size and age of every mesh file,
+	// so a different camera or image size still reuses the cache
+	static uint64_t hash(const nlohmann::json& config, int bvhWidth);
+
+	// Fills an empty scene from the cache, false if it is missing, out of date or unreadable
+	static bool read(const std::string& path, uint64_t hash, Scene& scene);
+	static bool write(const std::string& path, uint64_t hash, Scene& scene);
+
+private:
+	// Borrowed arrays were only checked for size, this makes sure every index in them is in range
+	static bool validMesh(TriangleMesh& mesh);
+};
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+class Tile
+{
+public:
+	int block; // Index into the block grid, halves of a split tile keep the block they came from
+	int x, width;
+	int y, endY; // Rows [y, endY) haven't been handed out yet
+};
+
+// Each thread works through its own queue of tiles a row at a time. Once it runs dry it steals
+// whole tiles from the back of other queues, then splits the tile another thread is still rendering.
+// Queues and the rows left of each thread's tile are single atomic words, so handing out work never locks
+class TileScheduler
+{
+public:
+	// With inOrder the threads take turns at tiles in reading order and steal from the front, so the whole frame
+	// moves down together for streaming output. No tile is started more than a few bands of tiles past the oldest
+	// unfinished one, threads split the tiles holding it up or wait instead, so only those bands are ever open.
+	// Images can be up to a million rows high and have up to 16 million tiles
+	TileScheduler(int imageWidth, int imageHeight, int blockSize, int threads, bool _inOrder = false);
+
+	// Gets the next row to render, false once there is nothing left to take or split.
+	// In order, asking for a row also means the thread's last one is finished
+	bool nextRow(int thread, Tile& tile, int& row);
+	// Seconds the thread spent looking for work or waiting for the last thread to finish, once every thread is done
+	double idleTime(int thread);
+
+private:
+	class WorkerQueue
+	{
+	public:
+		// Indices into TileScheduler::tiles, [head, tail) haven't been started. Both are packed into range so the
+		// owner taking from the front and a thief taking from either end can't both get the last tile
+		std::vector<int> tiles;
+		std::atomic<uint64_t> range;
+		// Rows of the tile being rendered that haven't been handed out, packed with the tile's index so a split
+		// always sees the tile its rows belong to. Only the owner takes rows, other threads only shorten it
+		std::atomic<uint64_t> active;
+		// Only touched by the queue's own thread
+		double idle = 0.0;
+		std::chrono::steady_clock::time_point finished;
+		int lastBand = -1; // Band of the row handed out last
+	};
+
+	std::vector<Tile> tiles;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	bool inOrder;
+
+	// Bands are rows of tiles, only tracked in order
+	int numBlocksX;
+	int bandsAhead;
+	std::atomic<int> tilesLeft; // Not started yet
+	std::atomic<int> oldestBand;
+	std::mutex bandMutex;
+	std::condition_variable bandFinished;
+	std::vector<int> bandRowsLeft;
+
+	bool findRow(int thread, Tile& tile, int& row);
+	bool canStart(int tile);
+	void finishRow(int band);
+	bool takeRow(WorkerQueue& queue, int& tile, int& row);
+	bool takeTile(WorkerQueue& queue, bool front, int& tile);
+	bool steal(int thread, uint64_t& stolen);
+	bool split(int thread, uint64_t& stolen);
+};
\ No newline at end of file
@@ -1,13 +1,32 @@
+#pragma once
+
 #include "vec3.hpp"
 #include "camera.hpp"
 #include "raycast.hpp"
+#include "aabb.hpp"
 
 class Shape
 {
 public:
-	virtual bool hit(Ray& ray, HitData& data) = 0;
+	virtual ~Shape() {}
+
+	// Finds the closest hit in [tMin, tMax), narrowing tMax to it. Only data.t is filled in,
+	// surface() is called once the closest hit over the whole scene is known
+	virtual bool hit(const Ray& ray, double tMin, double& tMax, HitData& data) = 0;
+	// Fills in the position, normal and face of a hit found by hit()
+	virtual void surface(const Ray& ray, HitData& data) = 0;
+	// Shadow ray query, true if anything is hit in [tMin, tMax)
+	virtual bool occludes(const Ray& ray, double tMin, double tMax) = 0;
+	// Unbounded shapes return false and are kept out of the BVH
+	virtual bool bounds(AABB& box) { return false; }
+
+	// For shapes used as lights: picks a unit direction from a point towards the shape and returns its pdf per unit
+	// solid angle, or 0 if the shape can't be sampled from there
+	virtual double sampleDirection(const Coords& from, Sampler& sampler, Vec3& dir) { return 0.0; }
+	// The pdf sampleDirection() gives a unit direction that hits the shape
+	virtual double directionPdf(const Coords& from, const Vec3& dir) { return 0.0; }
 
-	void handleFace(Ray& ray, HitData& data)
+	void handleFace(const Ray& ray, HitData& data)
 	{
 		if (ray.dir.dot(data.normal) <= 0.0) data.isFront = true;
 		else
@@ -26,27 +45,84 @@ public:
 
 	Sphere(Coords _pos, double _rad) : pos(_pos), rad(_rad) {}
 
-	bool hit(Ray& ray, HitData& data) override
+	bool hit(const Ray& ray, double tMin, double& tMax, HitData& data) override
 	{
 		Vec3 toCentre = ray.orig - pos;
-		double a = std::pow(ray.dir.length(), 2);
+		double a = ray.dir.lengthSquared();
 		double halfB = toCentre.dot(ray.dir);
-		double c = std::pow(toCentre.length(), 2) - std::pow(rad, 2);
-		double discriminant = std::pow(halfB, 2) - a * c;
+		double c = toCentre.lengthSquared() - rad * rad;
+		double discriminant = halfB * halfB - a * c;
 
 		if (discriminant < 0) return false;
-		auto sqrtd = std::sqrt(discriminant);
+		double sqrtd = std::sqrt(discriminant);
 
 		double root = (-halfB - sqrtd) / a;
-		if (root < IMPRECISION_DELTA)
+		if (root < tMin || root >= tMax)
 		{
 			root = (-halfB + sqrtd) / a;
-			if (root < IMPRECISION_DELTA) return false;
+			if (root < tMin || root >= tMax) return false;
 		}
 
-		data.pos = ray.orig + ray.dir * root;
-		data.normal = (data.pos - pos).unit();
+		tMax = root;
+		data.t = root;
+		return true;
+	}
+
+	void surface(const Ray& ray, HitData& data) override
+	{
+		data.pos = ray.orig + ray.dir * data.t;
+		data.normal = (data.pos - pos) / rad;
 		handleFace(ray, data);
+	}
+
+	bool occludes(const Ray& ray, double tMin, double tMax) override
+	{
+		double t = tMax;
+		HitData data;
+		return hit(ray, tMin, t, data);
+	}
+
+	bool bounds(AABB& box) override
+	{
+		box = AABB(pos - Vec3(rad, rad, rad), pos + Vec3(rad, rad, rad));
+		return true;
+	}
+
+	// Uniform over the cone of directions the sphere covers, so no samples are wasted on the side facing away
+	double sampleDirection(const Coords& from, Sampler& sampler, Vec3& dir) override
+	{
+		Vec3 toCentre = pos - from;
+		double oneMinusCosMax;
+		if (!coneFrom(toCentre, oneMinusCosMax)) return 0.0;
+
+		double height, turn;
+		sampler.next2D(height, turn);
+		double cosTheta = 1.0 - height * oneMinusCosMax;
+		double sinTheta = std::sqrt(std::fmax(0.0, 1.0 - cosTheta * cosTheta));
+		double phi = 2.0 * pi * turn;
+
+		Vec3 axis = toCentre.unit();
+		Vec3 tangent, bitangent;
+		axis.basis(tangent, bitangent);
+		dir = tangent * (sinTheta * std::cos(phi)) + bitangent * (sinTheta * std::sin(phi)) + axis * cosTheta;
+		return 1.0 / (2.0 * pi * oneMinusCosMax);
+	}
+
+	double directionPdf(const Coords& from, const Vec3& dir) override
+	{
+		double oneMinusCosMax;
+		if (!coneFrom(pos - from, oneMinusCosMax)) return 0.0;
+		return 1.0 / (2.0 * pi * oneMinusCosMax);
+	}
+
+private:
+	// Cone the sphere subtends, false from inside it. 1 - cos is worked out from sin squared so small or far
+	// away spheres don't lose it to cancellation
+	bool coneFrom(const Vec3& toCentre, double& oneMinusCosMax) const
+	{
+		double sinSquared = rad * rad / toCentre.lengthSquared();
+		if (sinSquared >= 1.0) return false;
+		oneMinusCosMax = sinSquared / (1.0 + std::sqrt(1.0 - sinSquared));
 		return true;
 	}
 };
@@ -55,18 +131,32 @@ class Plane : public Shape
 {
 public:
 	Coords point;
-	Vec3 normal;
+	Vec3 normal; // Unit length, hit and surface both rely on it
 
-	Plane(Coords _point, Vec3 _normal) : point(_point), normal(_normal) {}
+	// The normal can be any length but zero
+	Plane(Coords _point, Vec3 _normal) : point(_point), normal(_normal.unit()) {}
 
-	bool hit(Ray& ray, HitData& data) override
+	bool hit(const Ray& ray, double tMin, double& tMax, HitData& data) override
 	{
 		double root = (point - ray.orig).dot(normal) / ray.dir.dot(normal);
-		if (root < IMPRECISION_DELTA) return false;
+		// Written so a NaN from a ray parallel to the plane is rejected too
+		if (!(root >= tMin && root < tMax)) return false;
 
-		data.pos = ray.orig + ray.dir * root;
+		tMax = root;
+		data.t = root;
+		return true;
+	}
+
+	void surface(const Ray& ray, HitData& data) override
+	{
+		data.pos = ray.orig + ray.dir * data.t;
 		data.normal = normal;
 		handleFace(ray, data);
-		return true;
+	}
+
+	bool occludes(const Ray& ray, double tMin, double tMax) override
+	{
+		double root = (point - ray.orig).dot(normal) / ray.dir.dot(normal);
+		return root >= tMin && root < tMax;
 	}
 };
\ No newline at end of file
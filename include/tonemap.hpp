@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+#include "bitmap.hpp"
+
+// Post-process from the linear colours the renderer accumulates to display values in [0, 1] for 8-bit output.
+// HDR output skips it and keeps the linear values
+class ToneMapper
+{
+public:
+	enum Operator
+	{
+		CLAMP, // Cuts off everything brighter than white, how images have always looked
+		REINHARD, // c / (1 + c), compresses highlights instead of clipping them
+		ACES // Narkowicz's fit of the ACES filmic curve
+	};
+
+	Operator op;
+	double exposure;
+	// 2 matches the square root the renderer always corrected brightness with
+	double gamma;
+
+	ToneMapper(Operator _op = CLAMP, double _exposure = 1.0, double _gamma = 2.0) : op(_op), exposure(_exposure), gamma(_gamma) {}
+
+	// "clamp", "reinhard" or "aces", false for anything else
+	static bool parseOperator(const std::string& name, Operator& op);
+
+	Colour apply(const Colour& linear) const;
+
+private:
+	double curve(double value) const;
+};
\ No newline at end of file
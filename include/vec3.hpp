@@ -1,40 +1,138 @@
 #pragma once
 
+#include <cmath>
+
 class Angle;
 
-class Vec3
+// Build with RAYTRACER_FLOAT to do all vector maths in single precision
+#ifdef RAYTRACER_FLOAT
+typedef float real;
+#else
+typedef double real;
+#endif
+
+// RAYTRACER_ALIGN_VEC pads vectors to 16 byte boundaries so SSE/NEON can load them in one go.
+// Needs an allocator that honours the alignment (C++17 aligned new) when vectors are kept in containers
+#ifdef RAYTRACER_ALIGN_VEC
+#define VEC_ALIGN alignas(16)
+#else
+#define VEC_ALIGN
+#endif
+
+// Everything is inline and takes references so the hot maths can be inlined and vectorised in every translation unit
+template<typename T> class VEC_ALIGN Vec3T
 {
 public:
-	double x, y, z;
-
-	Vec3()
-	{
-		x = 0.0;
-		y = 0.0;
-		z = 0.0;
-	}
-
-	Vec3(double _x, double _y, double _z)
-	{
-		x = _x;
-		y = _y;
-		z = _z;
-	}
-
-	Vec3 operator/(double divisor);
-	Vec3 operator-(Vec3 n);
-	void operator-=(Vec3 n);
-	Vec3 operator+(Vec3 n);
-	Vec3 operator*(double n);
-	void operator*=(double n);
-	void operator+=(Vec3 n);
-	double length();
-	Vec3 unit();
-	double dist(Vec3 b);
-	double dot(Vec3 b);
-	bool operator==(Vec3 b);
-	bool operator!=(Vec3 b);
-	Vec3 operator-();
-	Vec3 fromAngle(Angle angle);
-	Vec3 cross(Vec3 b);
-};
\ No newline at end of file
+	T x, y, z;
+
+	Vec3T() : x(0), y(0), z(0) {}
+
+	Vec3T(T _x, T _y, T _z) : x(_x), y(_y), z(_z) {}
+
+	inline Vec3T operator/(T divisor) const
+	{
+		T inverse = T(1) / divisor;
+		return Vec3T(x * inverse, y * inverse, z * inverse);
+	}
+
+	inline Vec3T operator-(const Vec3T& n) const
+	{
+		return Vec3T(x - n.x, y - n.y, z - n.z);
+	}
+
+	inline void operator-=(const Vec3T& n)
+	{
+		x -= n.x;
+		y -= n.y;
+		z -= n.z;
+	}
+
+	inline Vec3T operator+(const Vec3T& n) const
+	{
+		return Vec3T(x + n.x, y + n.y, z + n.z);
+	}
+
+	inline Vec3T operator*(T n) const
+	{
+		return Vec3T(x * n, y * n, z * n);
+	}
+
+	inline void operator*=(T n)
+	{
+		x *= n;
+		y *= n;
+		z *= n;
+	}
+
+	inline void operator+=(const Vec3T& n)
+	{
+		x += n.x;
+		y += n.y;
+		z += n.z;
+	}
+
+	inline T lengthSquared() const
+	{
+		return x * x + y * y + z * z;
+	}
+
+	inline T length() const
+	{
+		return std::sqrt(lengthSquared());
+	}
+
+	inline Vec3T unit() const
+	{
+		return *this / length();
+	}
+
+	inline T dist(const Vec3T& b) const
+	{
+		return (b - *this).length();
+	}
+
+	inline T dot(const Vec3T& b) const
+	{
+		return x * b.x + y * b.y + z * b.z;
+	}
+
+	inline bool operator==(const Vec3T& b) const
+	{
+		return x == b.x && y == b.y && z == b.z;
+	}
+
+	inline bool operator!=(const Vec3T& b) const
+	{
+		return x != b.x || y != b.y || z != b.z;
+	}
+
+	inline Vec3T operator-() const
+	{
+		return Vec3T(-x, -y, -z);
+	}
+
+	// Defined in camera.hpp alongside Angle
+	Vec3T fromAngle(Angle angle);
+
+	inline Vec3T cross(const Vec3T& b) const
+	{
+		return Vec3T(y * b.z - z * b.y, z * b.x - x * b.z, x * b.y - y * b.x);
+	}
+
+	// Tangent and bitangent completing an orthonormal basis around this unit vector, Duff et al.'s branchless construction
+	inline void basis(Vec3T& tangent, Vec3T& bitangent) const
+	{
+		T sign = std::copysign(T(1), z);
+		T a = T(-1) / (sign + z);
+		T b = x * y * a;
+		tangent = Vec3T(T(1) + sign * x * x * a, sign * b, -sign * x);
+		bitangent = Vec3T(b, sign + y * y * a, -y);
+	}
+
+	inline T operator[](int axis) const
+	{
+		return axis == 0 ? x : (axis == 1 ? y : z);
+	}
+};
+
+typedef Vec3T<real> Vec3;
\ No newline at end of file
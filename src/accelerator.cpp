@@ -0,0 +1,68 @@
+#include "accelerator.hpp"
+#include "shapes.hpp"
+
+Accelerator::Accelerator(std::vector<Object>& _objects, int threads, int width) : objects(_objects)
+{
+	std::vector<AABB> boxes = classify();
+	bvh.build(boxes, threads);
+	bvh.collapse(width);
+}
+
+Accelerator::Accelerator(std::vector<Object>& _objects, BVH&& _bvh) : objects(_objects), bvh(std::move(_bvh))
+{
+	classify();
+}
+
+std::vector<AABB> Accelerator::classify()
+{
+	std::vector<AABB> boxes;
+	for (int i = 0; i < (int)objects.size(); i++)
+	{
+		AABB box;
+		if (objects[i].shape->bounds(box))
+		{
+			bounded.push_back(i);
+			boxes.push_back(box);
+		}
+		else unbounded.push_back(i);
+	}
+	return boxes;
+}
+
+bool Accelerator::intersect(const Ray& ray, double& tMax, HitData& hitData, Object*& object)
+{
+	bool hit = false;
+
+	// Unbounded shapes go first so their hits can cull the BVH traversal
+	for (int index : unbounded)
+	{
+		if (objects[index].shape->hit(ray, IMPRECISION_DELTA, tMax, hitData))
+		{
+			hit = true;
+			object = &objects[index];
+		}
+	}
+
+	bool hitBounded = bvh.closestHit(ray, tMax, [&](int prim, double& primTMax)
+	{
+		Object& obj = objects[bounded[prim]];
+		if (!obj.shape->hit(ray, IMPRECISION_DELTA, primTMax, hitData)) return false;
+		object = &obj;
+		return true;
+	});
+
+	return hit || hitBounded;
+}
+
+bool Accelerator::occluded(const Ray& ray, double tMax)
+{
+	for (int index : unbounded)
+	{
+		if (objects[index].shape->occludes(ray, IMPRECISION_DELTA, tMax)) return true;
+	}
+
+	return bvh.anyHit(ray, tMax, [&](int prim)
+	{
+		return objects[bounded[prim]].shape->occludes(ray, IMPRECISION_DELTA, tMax);
+	});
+}
\ No newline at end of file
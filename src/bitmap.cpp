@@ -1,4 +1,5 @@
 #include <fstream>
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <iostream>
@@ -9,29 +10,29 @@
 void Bitmap::setPixel(unsigned int x, unsigned int y, Colour colour)
 {
 	if (x >= width || y >= height) return;
-	data[y * width + x] = colour;
+	uint8_t* pixel = data + ((uint64_t)y * width + x) * 3;
+	pixel[0] = channelByte(colour.b);
+	pixel[1] = channelByte(colour.g);
+	pixel[2] = channelByte(colour.r);
 }
 
-bool Bitmap::save(std::string filename)
+uint8_t Bitmap::channelByte(double value)
 {
-	std::ofstream file;
-	file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
-	if (!file.is_open())
-	{
-		std::cout << "Couldn't open \"" << filename << "\"!" << std::endl;
-		return false;
-	}
+	return (uint8_t)(256 * std::max(std::min(value, 0.999), 0.0));
+}
 
-	// https://en.wikipedia.org/wiki/BMP_file_format
+unsigned int Bitmap::rowSize(unsigned int width)
+{
+	return (int)(std::ceil(24.0 * width / 32.0) * 4.0);
+}
 
+// https://en.wikipedia.org/wiki/BMP_file_format
+void Bitmap::writeHeader(std::ostream& file, unsigned int width, unsigned int height)
+{
 	const int headerSize = 12;
 	const int dibSize = 40;
-	const int colourPlanes = 1;
-	const int bpp = 24;
 
-	unsigned int rowSize = (int)(std::ceil(24.0 * width / 32.0) * 4.0);
-	int pixelArraySize = rowSize * height;
-	int offset = headerSize + dibSize;
+	int pixelArraySize = rowSize(width) * height;
 	int fileSize = pixelArraySize + headerSize + dibSize;
 
 	char fileHeaderData[] = {
@@ -59,22 +60,28 @@ bool Bitmap::save(std::string filename)
 	std::memcpy(fileHeaderData + 0x22, &pixelArraySize, 4);
 
 	file.write(fileHeaderData, sizeof(fileHeaderData));
+}
+
+bool Bitmap::save(std::string filename)
+{
+	std::ofstream file;
+	file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Couldn't open \"" << filename << "\"!" << std::endl;
+		return false;
+	}
 
+	writeHeader(file, width, height);
 
+	unsigned int rowSize = Bitmap::rowSize(width);
 	char* rowData = new char[rowSize + (uint64_t)10];
 
 	std::memset(rowData, 0, rowSize);
 
 	for (int y = height - 1; y >= 0; y--)
 	{
-		for (int x = 0; (unsigned int)x < width; x++)
-		{
-			uint64_t colourIndex = (uint64_t)y * width + x;
-			// Little-endian means we flip the normal order
-			rowData[x * 3] = 256 * std::max(std::min((double)data[colourIndex].b, 0.999), 0.0);
-			rowData[x * 3 + 1] = 256 * std::max(std::min((double)data[colourIndex].g, 0.999), 0.0);
-			rowData[x * 3 + 2] = 256 * std::max(std::min((double)data[colourIndex].r, 0.999), 0.0);
-		}
+		std::memcpy(rowData, data + (uint64_t)y * width * 3, (size_t)width * 3);
 		file.write(rowData, rowSize);
 	}
 
@@ -82,69 +89,10 @@ bool Bitmap::save(std::string filename)
 
 	delete[] rowData;
 
+	if (file.fail())
+	{
+		std::cout << "Couldn't write \"" << filename << "\"!" << std::endl;
+		return false;
+	}
 	return true;
-}
-
-Colour Colour::operator*(double n)
-{
-	return Colour((double)r * n, (double)g * n, (double)b * n);
-}
-
-void Colour::operator*=(double n)
-{
-	*this = *this * n;
-}
-
-void Colour::operator*=(Colour n)
-{
-	r *= n.r;
-	g *= n.g;
-	b *= n.b;
-}
-
-Colour Colour::operator/(double n)
-{
-	return Colour((double)r / n, (double)g / n, (double)b / n);
-}
-
-Colour Colour::operator+(Colour n)
-{
-	return Colour(r + n.r, g + n.g, b + n.b);
-}
-
-void Colour::operator+=(Colour n)
-{
-	r += n.r;
-	g += n.g;
-	b += n.b;
-}
-
-void Colour::operator/=(double n)
-{
-	*this = *this / n;
-}
-
-Colour Colour::map(double (*fun)(double))
-{
-	return Colour(fun(r), fun(g), fun(b));
-}
-
-Colour Colour::operator-(Colour n)
-{
-	return Colour(std::max(0.0, r - n.r), std::max(0.0, g - n.g), std::max(0.0, b - n.b));
-}
-
-void Colour::operator-=(Colour n)
-{
-	r -= n.r;
-	g -= n.g;
-	b -= n.b;
-	r = std::max(0.0, r);
-	g = std::max(0.0, g);
-	b = std::max(0.0, b);
-}
-
-Colour Colour::inverse()
-{
-	return Colour(1.0 - r, 1.0 - g, 1.0 - b);
 }
\ No newline at end of file
@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "bvh.hpp"
+
+// Relative costs used by the surface area heuristic
+const double TRAVERSAL_COST = 1.0;
+const double INTERSECT_COST = 1.0;
+const int MAX_LEAF_SIZE = 8;
+const int BIN_COUNT = 16;
+// Past this depth nodes are split at the median so the traversal stack can't overflow
+const int MAX_SAH_DEPTH = 64;
+// Subtrees smaller than this are finished by the thread that split them off
+const int TASK_THRESHOLD = 4096;
+
+void AABB::grow(const Coords& point)
+{
+	min = Coords(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+	max = Coords(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+}
+
+void AABB::grow(const AABB& box)
+{
+	grow(box.min);
+	grow(box.max);
+}
+
+Coords AABB::centre() const
+{
+	return (min + max) * 0.5;
+}
+
+double AABB::surfaceArea() const
+{
+	Vec3 size = max - min;
+	if (size.x < 0.0 || size.y < 0.0 || size.z < 0.0) return 0.0;
+	return 2.0 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+class BuildTask
+{
+public:
+	int node, begin, end, depth;
+};
+
+class BVHBuilder
+{
+public:
+	BVHBuilder(BVH& _bvh, std::vector<AABB>& _boxes, int _threads) : bvh(_bvh), boxes(_boxes), threads(_threads)
+	{
+		centres.reserve(boxes.size());
+		for (auto& box : boxes) centres.push_back(box.centre());
+	}
+
+	// Returns the number of nodes used
+	int run()
+	{
+		push(BuildTask{ 0, 0, (int)boxes.size(), 0 });
+
+		std::vector<std::thread> workers;
+		for (int thread = 1; thread < threads; thread++) workers.push_back(std::thread(&BVHBuilder::worker, this));
+		worker();
+		for (auto& thread : workers) thread.join();
+
+		return nodeCount;
+	}
+
+private:
+	BVH& bvh;
+	std::vector<AABB>& boxes;
+	std::vector<Coords> centres;
+	int threads;
+
+	std::atomic<int> nodeCount{ 1 };
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	std::vector<BuildTask> queue;
+	int pending = 0;
+
+	void push(BuildTask task)
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queue.push_back(task);
+		pending++;
+		queueCondition.notify_one();
+	}
+
+	void worker()
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		while (true)
+		{
+			queueCondition.wait(lock, [&] { return !queue.empty() || pending == 0; });
+			if (queue.empty()) return;
+
+			BuildTask task = queue.back();
+			queue.pop_back();
+			lock.unlock();
+			buildNode(task.node, task.begin, task.end, task.depth);
+			lock.lock();
+
+			if (--pending == 0) queueCondition.notify_all();
+		}
+	}
+
+	void buildNode(int node, int begin, int end, int depth)
+	{
+		Buffer<int>& indices = bvh.indices;
+
+		AABB box, centreBox;
+		for (int i = begin; i < end; i++)
+		{
+			box.grow(boxes[indices[i]]);
+			centreBox.grow(centres[indices[i]]);
+		}
+		BVHNode& current = bvh.nodes[node];
+		current.box = box;
+		current.first = begin;
+		current.count = end - begin;
+		current.left = 0;
+
+		int count = end - begin;
+		if (count == 1) return;
+
+		Vec3 extent = centreBox.max - centreBox.min;
+		double parentArea = box.surfaceArea();
+
+		int bestAxis = -1;
+		int bestBin = 0;
+		double bestCost = std::numeric_limits<double>::infinity();
+
+		if (depth < MAX_SAH_DEPTH && parentArea > 0.0)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (extent[axis] <= 0.0) continue;
+
+				AABB binBoxes[BIN_COUNT];
+				int binCounts[BIN_COUNT] = {};
+				double binMin = centreBox.min[axis];
+				double scale = BIN_COUNT / extent[axis];
+				for (int i = begin; i < end; i++)
+				{
+					int bin = std::min(BIN_COUNT - 1, (int)((centres[indices[i]][axis] - binMin) * scale));
+					binBoxes[bin].grow(boxes[indices[i]]);
+					binCounts[bin]++;
+				}
+
+				// Sweep from the right, then evaluate each plane between bins from the left
+				double rightArea[BIN_COUNT];
+				int rightCount[BIN_COUNT];
+				AABB sweep;
+				int sweepCount = 0;
+				for (int bin = BIN_COUNT - 1; bin > 0; bin--)
+				{
+					sweep.grow(binBoxes[bin]);
+					sweepCount += binCounts[bin];
+					rightArea[bin] = sweep.surfaceArea();
+					rightCount[bin] = sweepCount;
+				}
+				sweep = AABB();
+				sweepCount = 0;
+				for (int bin = 1; bin < BIN_COUNT; bin++)
+				{
+					sweep.grow(binBoxes[bin - 1]);
+					sweepCount += binCounts[bin - 1];
+					if (sweepCount == 0 || rightCount[bin] == 0) continue;
+					double cost = TRAVERSAL_COST + INTERSECT_COST * (sweep.surfaceArea() * sweepCount + rightArea[bin] * rightCount[bin]) / parentArea;
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = bin;
+					}
+				}
+			}
+		}
+
+		if (bestAxis != -1 && bestCost >= INTERSECT_COST * count && count <= MAX_LEAF_SIZE) return;
+
+		int mid = begin;
+		if (bestAxis != -1)
+		{
+			double binMin = centreBox.min[bestAxis];
+			double scale = BIN_COUNT / extent[bestAxis];
+			mid = (int)(std::partition(indices.begin() + begin, indices.begin() + end, [&](int prim)
+			{
+				return std::min(BIN_COUNT - 1, (int)((centres[prim][bestAxis] - binMin) * scale)) < bestBin;
+			}) - indices.begin());
+		}
+		if (mid == begin || mid == end)
+		{
+			// Too deep or every centre is in the same spot, fall back to a median split
+			if (count <= MAX_LEAF_SIZE) return;
+			int axis = 0;
+			if (extent.y > extent[axis]) axis = 1;
+			if (extent.z > extent[axis]) axis = 2;
+			mid = begin + count / 2;
+			std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end, [&](int a, int b) { return centres[a][axis] < centres[b][axis]; });
+		}
+
+		int left = nodeCount.fetch_add(2);
+		current.left = left;
+		current.count = 0;
+
+		if (threads > 1 && end - mid >= TASK_THRESHOLD) push(BuildTask{ left + 1, mid, end, depth + 1 });
+		else buildNode(left + 1, mid, end, depth + 1);
+		buildNode(left, begin, mid, depth + 1);
+	}
+};
+
+void BVH::build(std::vector<AABB>& boxes, int threads)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	nodes.clear();
+	indices.resize(boxes.size());
+	if (!boxes.empty())
+	{
+		std::iota(indices.begin(), indices.end(), 0);
+
+		// A binary tree with n leaves never has more than 2n - 1 nodes
+		nodes.resize(2 * boxes.size() - 1);
+		BVHBuilder builder(*this, boxes, std::max(1, threads));
+		nodes.resize(builder.run());
+		nodes.shrink_to_fit();
+	}
+
+	buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Rounds outwards so the float bounds always contain the double ones
+static float roundDown(double value)
+{
+	float rounded = (float)value;
+	return (double)rounded > value ? std::nextafter(rounded, -FLT_MAX) : rounded;
+}
+
+static float roundUp(double value)
+{
+	float rounded = (float)value;
+	return (double)rounded < value ? std::nextafter(rounded, FLT_MAX) : rounded;
+}
+
+template<int N> int BVH::collapseNode(int node, Buffer<WideNode<N>>& wideNodes)
+{
+	int index = (int)wideNodes.size();
+	wideNodes.push_back(WideNode<N>());
+
+	// Keep opening the interior child with the biggest surface area until all N slots are used
+	int children[N];
+	int used = 1;
+	children[0] = node;
+	while (used < N)
+	{
+		int open = -1;
+		double openArea = -1.0;
+		for (int i = 0; i < used; i++)
+		{
+			if (nodes[children[i]].count > 0) continue;
+			double area = nodes[children[i]].box.surfaceArea();
+			if (area > openArea)
+			{
+				open = i;
+				openArea = area;
+			}
+		}
+		if (open == -1) break;
+		int opened = children[open];
+		children[open] = nodes[opened].left;
+		children[used++] = nodes[opened].left + 1;
+	}
+
+	for (int i = 0; i < N; i++)
+	{
+		WideNode<N>& wide = wideNodes[index];
+		if (i >= used)
+		{
+			wide.minX[i] = wide.minY[i] = wide.minZ[i] = 0.0f;
+			wide.maxX[i] = wide.maxY[i] = wide.maxZ[i] = 0.0f;
+			wide.child[i] = 0;
+			wide.count[i] = 0;
+			continue;
+		}
+
+		BVHNode& child = nodes[children[i]];
+		wide.minX[i] = roundDown(child.box.min.x);
+		wide.minY[i] = roundDown(child.box.min.y);
+		wide.minZ[i] = roundDown(child.box.min.z);
+		wide.maxX[i] = roundUp(child.box.max.x);
+		wide.maxY[i] = roundUp(child.box.max.y);
+		wide.maxZ[i] = roundUp(child.box.max.z);
+		wide.count[i] = child.count;
+		wide.child[i] = child.first;
+	}
+	wideNodes[index].used = used;
+
+	// Recursing can reallocate wideNodes, so references are only taken after each call
+	for (int i = 0; i < used; i++)
+	{
+		if (nodes[children[i]].count > 0) continue;
+		int childIndex = collapseNode(children[i], wideNodes);
+		wideNodes[index].child[i] = childIndex;
+	}
+	return index;
+}
+
+bool BVH::validate(size_t primitives)
+{
+	for (int index : indices)
+	{
+		if (index < 0 || (size_t)index >= primitives) return false;
+	}
+	if (width == 4) return validateWide(nodes4);
+	if (width == 8) return validateWide(nodes8);
+	if (width != 2) return false;
+	if (indices.empty()) return true;
+	if (nodes.empty()) return false;
+
+	// Children always come after their parent, so one pass in order sees each parent's depth before its children
+	std::vector<int> depths(nodes.size(), -1);
+	depths[0] = 0;
+	for (size_t node = 0; node < nodes.size(); node++)
+	{
+		const BVHNode& current = nodes[node];
+		if (depths[node] == -1) continue;
+		if (current.count > 0)
+		{
+			if (!validateLeaf(current.first, current.count)) return false;
+			continue;
+		}
+		if (current.count < 0 || current.left <= (int)node || (size_t)current.left + 1 >= nodes.size()) return false;
+		for (int child = current.left; child <= current.left + 1; child++)
+		{
+			// A child reached twice would mean the tree isn't one
+			if (depths[child] != -1 || depths[node] + 1 >= BVH_STACK_SIZE) return false;
+			depths[child] = depths[node] + 1;
+		}
+	}
+	return true;
+}
+
+template<int N> bool BVH::validateWide(const Buffer<WideNode<N>>& wideNodes)
+{
+	if (indices.empty()) return true;
+	if (wideNodes.empty()) return false;
+
+	std::vector<int> depths(wideNodes.size(), -1);
+	depths[0] = 0;
+	for (size_t node = 0; node < wideNodes.size(); node++)
+	{
+		const WideNode<N>& current = wideNodes[node];
+		if (depths[node] == -1) continue;
+		if (current.used < 1 || current.used > N) return false;
+		for (int i = 0; i < current.used; i++)
+		{
+			int child = current.child[i];
+			if (current.count[i] > 0)
+			{
+				if (!validateLeaf(child, current.count[i])) return false;
+				continue;
+			}
+			if (current.count[i] < 0 || child <= (int)node || (size_t)child >= wideNodes.size()) return false;
+			if (depths[child] != -1 || depths[node] + 1 >= BVH_STACK_SIZE) return false;
+			depths[child] = depths[node] + 1;
+		}
+	}
+	return true;
+}
+
+bool BVH::validateLeaf(int first, int count)
+{
+	return first >= 0 && (size_t)first <= indices.size() && (size_t)count <= indices.size() - first;
+}
+
+void BVH::collapse(int _width)
+{
+	width = _width;
+	nodes4.clear();
+	nodes8.clear();
+	if (width != 4 && width != 8)
+	{
+		width = 2;
+		return;
+	}
+	if (nodes.empty()) return;
+
+	if (width == 4) collapseNode(0, nodes4);
+	else collapseNode(0, nodes8);
+
+	nodes.clear();
+}
+
+int BVH::nodeCount()
+{
+	if (width == 4) return (int)nodes4.size();
+	if (width == 8) return (int)nodes8.size();
+	return (int)nodes.size();
+}
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+#include "framebuffer.hpp"
+
+double PixelStats::error() const
+{
+	if (samples < 2) return std::numeric_limits<double>::infinity();
+	double variance = (double)squaredDiffs / (samples - 1);
+	double halfWidth = 1.96 * std::sqrt(variance / samples);
+	return halfWidth / (2.0 * std::sqrt(std::fmax((double)mean, 0.0001)));
+}
+
+Framebuffer::Framebuffer(int _width, int _height, bool _perPixelStats)
+	: width(_width), height(_height), perPixelStats(_perPixelStats), sums((size_t)_width * _height * 3, 0.0f),
+	pixelStats(_perPixelStats ? (size_t)_width * _height : 0, PixelStats{ 0, 0.0f, 0.0f })
+{
+}
+
+void Framebuffer::add(int x, int y, const Colour& sum, const PixelStats& stats)
+{
+	size_t pixel = (size_t)y * width + x;
+	sums[pixel * 3] += (float)sum.r;
+	sums[pixel * 3 + 1] += (float)sum.g;
+	sums[pixel * 3 + 2] += (float)sum.b;
+	if (perPixelStats) pixelStats[pixel] = stats;
+}
+
+Colour Framebuffer::average(int x, int y) const
+{
+	size_t pixel = (size_t)y * width + x;
+	uint32_t pixelSamples = perPixelStats ? pixelStats[pixel].samples : samples;
+	if (pixelSamples == 0) return Colour(0, 0, 0);
+	return Colour(sums[pixel * 3], sums[pixel * 3 + 1], sums[pixel * 3 + 2]) / (real)pixelSamples;
+}
+
+double Framebuffer::noise() const
+{
+	double total = 0.0;
+	size_t counted = 0;
+	for (auto& stats : pixelStats)
+	{
+		if (stats.samples < 2) continue;
+		total += stats.error();
+		counted++;
+	}
+	return counted > 0 ? total / counted : std::numeric_limits<double>::infinity();
+}
+
+void Framebuffer::toBitmap(Bitmap& image, const ToneMapper& toneMapper) const
+{
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			image.setPixel(x, y, toneMapper.apply(average(x, y)));
+		}
+	}
+}
+
+static bool openOutput(std::ofstream& file, const std::string& filename)
+{
+	file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Couldn't open \"" << filename << "\"!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// A write that failed part way through, such as on a full disk, leaves the stream failed
+static bool closeOutput(std::ofstream& file, const std::string& filename)
+{
+	file.close();
+	if (file.fail())
+	{
+		std::cout << "Couldn't write \"" << filename << "\"!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Both formats are little-endian here, like the BMP writer this won't work on big-endian systems
+template<typename T> static void put(std::vector<char>& out, T value)
+{
+	size_t offset = out.size();
+	out.resize(offset + sizeof(T));
+	std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+static void putString(std::vector<char>& out, const char* text)
+{
+	out.insert(out.end(), text, text + std::strlen(text) + 1);
+}
+
+// https://www.pauldebevec.com/Research/HDR/PFM/, a negative scale means little-endian and rows go bottom to top
+bool Framebuffer::savePFM(const std::string& filename) const
+{
+	std::ofstream file;
+	if (!openOutput(file, filename)) return false;
+
+	file << "PF\n" << width << " " << height << "\n-1.0\n";
+	std::vector<float> row((size_t)width * 3);
+	for (int y = height - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			Colour colour = average(x, y);
+			row[x * 3] = (float)colour.r;
+			row[x * 3 + 1] = (float)colour.g;
+			row[x * 3 + 2] = (float)colour.b;
+		}
+		file.write((const char*)row.data(), row.size() * sizeof(float));
+	}
+	return closeOutput(file, filename);
+}
+
+static void putAttribute(std::vector<char>& header, const char* name, const char* type, const std::vector<char>& value)
+{
+	putString(header, name);
+	putString(header, type);
+	put<int32_t>(header, (int32_t)value.size());
+	header.insert(header.end(), value.begin(), value.end());
+}
+
+// OpenEXR's RLE: runs of 3 to 128 equal bytes are stored as (length - 1, byte), anything else as
+// (-length, bytes...) with at most 127 bytes at a time
+static void rleCompress(const std::vector<char>& in, std::vector<char>& out)
+{
+	const int MIN_RUN = 3;
+	const int MAX_RUN = 127;
+	out.clear();
+	size_t size = in.size();
+	size_t runStart = 0;
+	size_t runEnd = 1;
+	while (runStart < size)
+	{
+		while (runEnd < size && in[runStart] == in[runEnd] && runEnd - runStart - 1 < MAX_RUN) runEnd++;
+		if (runEnd - runStart >= MIN_RUN)
+		{
+			out.push_back((char)(runEnd - runStart - 1));
+			out.push_back(in[runStart]);
+			runStart = runEnd;
+		}
+		else
+		{
+			while (runEnd < size &&
+				((runEnd + 1 >= size || in[runEnd] != in[runEnd + 1]) || (runEnd + 2 >= size || in[runEnd + 1] != in[runEnd + 2])) &&
+				runEnd - runStart < MAX_RUN) runEnd++;
+			out.push_back((char)-(int)(runEnd - runStart));
+			out.insert(out.end(), in.begin() + runStart, in.begin() + runEnd);
+			runStart = runEnd;
+		}
+		runEnd++;
+	}
+}
+
+// Before run length encoding OpenEXR splits the even and odd bytes and stores the differences between neighbours,
+// which turns the slowly changing high bytes of floats into runs
+static void rlePredict(const std::vector<char>& in, std::vector<char>& out)
+{
+	size_t size = in.size();
+	out.resize(size);
+	size_t half = (size + 1) / 2;
+	for (size_t i = 0; i < size; i++) out[(i % 2 == 0 ? 0 : half) + i / 2] = in[i];
+
+	int previous = (unsigned char)out[0];
+	for (size_t i = 1; i < size; i++)
+	{
+		int current = (unsigned char)out[i];
+		out[i] = (char)(current - previous + 128 + 256);
+		previous = current;
+	}
+}
+
+// https://openexr.com/en/latest/OpenEXRFileLayout.html
+bool Framebuffer::saveEXR(const std::string& filename, bool rle) const
+{
+	std::ofstream file;
+	if (!openOutput(file, filename)) return false;
+
+	std::vector<char> header;
+	put<int32_t>(header, 20000630); // Magic number
+	put<int32_t>(header, 2); // Version 2, single part scanline file
+
+	// Channels have to be in alphabetical order, all 32-bit float (pixel type 2) and not subsampled
+	std::vector<char> channels;
+	const char* channelNames[] = { "B", "G", "R" };
+	for (const char* name : channelNames)
+	{
+		putString(channels, name);
+		put<int32_t>(channels, 2);
+		put<int32_t>(channels, 0); // pLinear and reserved
+		put<int32_t>(channels, 1);
+		put<int32_t>(channels, 1);
+	}
+	channels.push_back(0);
+	putAttribute(header, "channels", "chlist", channels);
+
+	std::vector<char> value;
+	value.push_back(rle ? 1 : 0);
+	putAttribute(header, "compression", "compression", value);
+
+	value.clear();
+	put<int32_t>(value, 0);
+	put<int32_t>(value, 0);
+	put<int32_t>(value, width - 1);
+	put<int32_t>(value, height - 1);
+	putAttribute(header, "dataWindow", "box2i", value);
+	putAttribute(header, "displayWindow", "box2i", value);
+
+	value.assign(1, 0); // Increasing y
+	putAttribute(header, "lineOrder", "lineOrder", value);
+
+	value.clear();
+	put<float>(value, 1.0f);
+	putAttribute(header, "pixelAspectRatio", "float", value);
+	putAttribute(header, "screenWindowWidth", "float", value);
+
+	value.clear();
+	put<float>(value, 0.0f);
+	put<float>(value, 0.0f);
+	putAttribute(header, "screenWindowCenter", "v2f", value);
+	header.push_back(0);
+
+	file.write(header.data(), header.size());
+
+	// Both compressions store one scanline per chunk, the offset table points at each one
+	uint64_t offset = header.size() + (uint64_t)height * sizeof(uint64_t);
+	std::vector<uint64_t> offsets(height);
+	std::streampos tablePos = file.tellp();
+	file.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+
+	std::vector<char> line, predicted, compressed;
+	for (int y = 0; y < height; y++)
+	{
+		// Each channel's values for the whole line, one after the other
+		line.clear();
+		for (int channel = 2; channel >= 0; channel--)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				Colour colour = average(x, y);
+				put<float>(line, (float)(channel == 0 ? colour.r : (channel == 1 ? colour.g : colour.b)));
+			}
+		}
+
+		const std::vector<char>* data = &line;
+		if (rle)
+		{
+			rlePredict(line, predicted);
+			rleCompress(predicted, compressed);
+			// Chunks that don't get any smaller are stored as they are
+			if (compressed.size() < line.size()) data = &compressed;
+		}
+
+		offsets[y] = offset;
+		int32_t chunkHeader[2] = { y, (int32_t)data->size() };
+		file.write((const char*)chunkHeader, sizeof(chunkHeader));
+		file.write(data->data(), data->size());
+		offset += sizeof(chunkHeader) + data->size();
+	}
+
+	file.seekp(tablePos);
+	file.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+	return closeOutput(file, filename);
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+#include "imagewriter.hpp"
+
+static bool endsWith(const std::string& text, const std::string& suffix)
+{
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool StreamingImageWriter::formatFor(const std::string& filename, Format& format)
+{
+	if (endsWith(filename, ".bmp")) format = BMP;
+	else if (endsWith(filename, ".ppm")) format = PPM;
+	else if (endsWith(filename, ".pfm")) format = PFM;
+	else return false;
+	return true;
+}
+
+bool StreamingImageWriter::open(const std::string& filename, Format _format)
+{
+	format = _format;
+	path = filename;
+	file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Couldn't open \"" << filename << "\"!" << std::endl;
+		return false;
+	}
+
+	if (format == BMP) Bitmap::writeHeader(file, width, height);
+	else
+	{
+		// A negative PFM scale means little-endian, which like the BMP writer is all this supports
+		std::ostringstream header;
+		if (format == PPM) header << "P6\n" << width << " " << height << "\n255\n";
+		else header << "PF\n" << width << " " << height << "\n-1.0\n";
+		file << header.str();
+	}
+	headerSize = file.tellp();
+	return true;
+}
+
+void StreamingImageWriter::writeRow(int x, int y, int count, const Colour* pixels)
+{
+	int band = y / bandHeight;
+	Band finished;
+	{
+		std::lock_guard<std::mutex> lock(bandMutex);
+		auto found = bands.find(band);
+		if (found == bands.end())
+		{
+			int rows = std::min(bandHeight, height - band * bandHeight);
+			found = bands.emplace(band, Band()).first;
+			found->second.pixels.resize((size_t)rows * width * 3);
+			found->second.pixelsLeft = (int64_t)rows * width;
+			peakBands = std::max(peakBands, (int)bands.size());
+		}
+
+		Band& data = found->second;
+		float* row = data.pixels.data() + ((size_t)(y - band * bandHeight) * width + x) * 3;
+		for (int i = 0; i < count; i++)
+		{
+			row[i * 3] = (float)pixels[i].r;
+			row[i * 3 + 1] = (float)pixels[i].g;
+			row[i * 3 + 2] = (float)pixels[i].b;
+		}
+		data.pixelsLeft -= count;
+		if (data.pixelsLeft > 0) return;
+
+		finished = std::move(data);
+		bands.erase(found);
+	}
+	writeBand(band, finished);
+}
+
+void StreamingImageWriter::writeBand(int band, const Band& data)
+{
+	int firstRow = band * bandHeight;
+	int rows = (int)(data.pixels.size() / ((size_t)width * 3));
+
+	std::streamoff rowBytes;
+	if (format == BMP) rowBytes = Bitmap::rowSize(width);
+	else if (format == PPM) rowBytes = (std::streamoff)width * 3;
+	else rowBytes = (std::streamoff)width * 3 * sizeof(float);
+	std::vector<char> encoded((size_t)rowBytes, 0);
+
+	std::lock_guard<std::mutex> lock(fileMutex);
+	for (int row = 0; row < rows; row++)
+	{
+		int y = firstRow + row;
+		const float* source = data.pixels.data() + (size_t)row * width * 3;
+		if (format == PFM) std::memcpy(encoded.data(), source, (size_t)width * 3 * sizeof(float));
+		else
+		{
+			for (int x = 0; x < width; x++)
+			{
+				Colour colour = toneMapper.apply(Colour(source[x * 3], source[x * 3 + 1], source[x * 3 + 2]));
+				uint8_t* pixel = (uint8_t*)encoded.data() + x * 3;
+				// BMP stores blue first
+				pixel[format == BMP ? 2 : 0] = Bitmap::channelByte(colour.r);
+				pixel[1] = Bitmap::channelByte(colour.g);
+				pixel[format == BMP ? 0 : 2] = Bitmap::channelByte(colour.b);
+			}
+		}
+
+		std::streamoff fileRow = format == PPM ? y : height - 1 - y;
+		file.seekp(headerSize + fileRow * rowBytes);
+		file.write(encoded.data(), rowBytes);
+	}
+}
+
+bool StreamingImageWriter::close()
+{
+	if (!bands.empty()) std::cout << "Image is missing " << bands.size() << " bands of tiles" << std::endl;
+	// A seek or write that failed part way through, such as on a full disk, leaves the stream failed
+	file.close();
+	if (file.fail())
+	{
+		std::cout << "Couldn't write \"" << path << "\"!" << std::endl;
+		return false;
+	}
+	return bands.empty();
+}
\ No newline at end of file
@@ -1,32 +1,59 @@
 #include <iostream>
 #include <thread>
 #include <cassert>
-#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <random>
+#include <memory>
 
 #include "camera.hpp"
 #include "bitmap.hpp"
 #include "raycast.hpp"
-#include "conmanip.h"
 #include "object.hpp"
-#include "materials.hpp"
-#include "shapes.hpp"
+#include "scene.hpp"
+#include "scheduler.hpp"
+#include "progress.hpp"
+#include "framebuffer.hpp"
+#include "tonemap.hpp"
+#include "imagewriter.hpp"
 #include "json.h"
 
 int maxBounces = 25;
+int rouletteDepth = 3;
 int width = 640;
 int height = 480;
 int blockSize = 50;
 int aaSamples = 50;
-
-int numBlocksX;
-int numBlocksY;
-int numBlocks;
-
-int conOffsetX, conOffsetY;
-
-std::mutex blockAssignMutex;
-bool* blocks;
+// Adaptive sampling stops a pixel after minSamples once its 95% confidence interval is narrower than the threshold,
+// measured after the square root brightness correction. A threshold of 0 always takes aaSamples
+int minSamples = 8;
+double noiseThreshold = 0.0;
+int bvhWidth = 4;
+bool deterministic = true;
+uint64_t frameSeed = 0;
+std::string samplerType = "pcg";
+
+std::string sceneCache = "";
+
+std::string progressMode = "console";
+double progressInterval = 1.0;
+
+// Progressive rendering goes over the whole frame at 1, 2, 4... samples per pixel until it has aaSamples,
+// the time budget (seconds) runs out or the frame's average error is below the noise target. 0 turns either off
+bool progressive = false;
+double timeBudget = 0.0;
+double noiseTarget = 0.0;
+// Saves the output after every pass so there is something to look at early on
+bool progressiveSnapshots = false;
+
+// The extension picks the format: .bmp is tone mapped to 8 bits, .pfm and .exr keep the linear HDR values
+std::string outputFile = "out.bmp";
+bool exrRLE = true;
+ToneMapper toneMapper;
+// Writes bands of tiles to the output as they finish instead of keeping the frame, for images too big to hold.
+// Only for .bmp, .ppm and .pfm output and not with progressive rendering
+bool streamingOutput = false;
 
 template<typename T> bool getConfigVar(nlohmann::json& config, std::string name, T& var)
 {
@@ -42,67 +69,117 @@ template<typename T> bool getConfigVar(nlohmann::json& config, std::string name,
 	}
 }
 
-void doPart(int number, Bitmap& image, Camera& camera, std::vector<Object>& objects, std::vector<Light>& lights)
+bool endsWith(const std::string& text, const std::string& suffix)
 {
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<> dis(-1.0, 1.0);
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
 
-	while (true)
+bool saveImage(Framebuffer& framebuffer)
+{
+	if (endsWith(outputFile, ".pfm")) return framebuffer.savePFM(outputFile);
+	else if (endsWith(outputFile, ".exr")) return framebuffer.saveEXR(outputFile, exrRLE);
+	else if (endsWith(outputFile, ".ppm"))
 	{
-		int blockX = -1;
-		int blockY = -1;
-		blockAssignMutex.lock();
-		for (int block = 0; block < numBlocks; block++)
+		StreamingImageWriter writer(framebuffer.width, framebuffer.height, 1, toneMapper);
+		if (!writer.open(outputFile, StreamingImageWriter::PPM)) return false;
+		std::vector<Colour> row(framebuffer.width);
+		for (int y = 0; y < framebuffer.height; y++)
 		{
-			if (!blocks[block])
-			{
-				blockX = block % numBlocksX;
-				blockY = block / numBlocksX;
-				blocks[block] = true;
-				std::cout
-					<< conmanip::setpos(conOffsetX + blockX * 2, conOffsetY + blockY)
-					<< conmanip::settextcolor(conmanip::console_text_colors::yellow)
-					<< number
-					<< conmanip::settextcolor(conmanip::console_text_colors::white);
-				break;
-			}
+			for (int x = 0; x < framebuffer.width; x++) row[x] = framebuffer.average(x, y);
+			writer.writeRow(0, y, framebuffer.width, row.data());
 		}
-		blockAssignMutex.unlock();
-		if (blockX == -1) return;
+		return writer.close();
+	}
+	else
+	{
+		Bitmap image(framebuffer.width, framebuffer.height);
+		framebuffer.toBitmap(image, toneMapper);
+		return image.save(outputFile);
+	}
+}
 
-		unsigned int x = blockX * blockSize;
-		unsigned int y = blockY * blockSize;
+// Takes up to passSamples more samples for every pixel, stopping early on pixels that have converged.
+// Pixels are added to the framebuffer or, when streaming, handed to the writer a row at a time
+void doPart(int number, Framebuffer* framebuffer, StreamingImageWriter* stream, Camera& camera, Accelerator& accel, std::vector<Light>& lights, TileScheduler& scheduler, RenderProgress& progress, int passSamples)
+{
+	std::unique_ptr<Sampler> sampler;
+	if (samplerType == "sobol") sampler.reset(new SobolSampler(frameSeed, false, aaSamples));
+	else if (samplerType == "blue_noise") sampler.reset(new SobolSampler(frameSeed, true, aaSamples));
+	else sampler.reset(new PCGSampler(frameSeed));
+
+	Tile tile;
+	int y;
+	int currentBlock = -1;
+	uint64_t reportedRays = 0;
+	uint64_t reportedSegments = 0;
+	uint64_t rowPaths = 0;
+	int samplesFloor = noiseThreshold > 0.0 ? std::max(minSamples, 2) : aaSamples;
+	std::vector<Colour> rowPixels;
+	while (scheduler.nextRow(number, tile, y))
+	{
+		if (tile.block != currentBlock)
+		{
+			currentBlock = tile.block;
+			progress.startBlock(currentBlock, number);
+		}
 
-		for (int dY = 0; dY < blockSize; dY++)
+		for (int x = tile.x; x < tile.x + tile.width; x++)
 		{
-			if (y + dY >= image.height) break;
-			for (int dX = 0; dX < blockSize; dX++)
+			Colour calculated(0.0, 0.0, 0.0);
+			// Carries on from the earlier passes, kept in double while sampling
+			PixelStats stats = framebuffer ? framebuffer->stats(x, y) : PixelStats{ 0, 0.0f, 0.0f };
+			double mean = stats.mean;
+			double squaredDiffs = stats.squaredDiffs;
+
+			int samples = stats.samples;
+			int firstSample = samples;
+			int endSample = std::min(samples + passSamples, aaSamples);
+			while (samples < endSample)
 			{
-				if (x + dX >= image.width) break;
-				Colour calculated(0.0, 0.0, 0.0);
-				double dTheta = -camera.fovHoriz / image.width * ((double)x + dX);
-				double dPhi = camera.fovVert / image.height * ((double)y + dY);
-				Angle ray = Angle().fromVec3(camera.viewplaneTL).delta(dTheta, dPhi);
-
-				for (int aa = 0; aa < aaSamples; aa++)
+				if (samples >= samplesFloor)
 				{
-					Angle rayDelta = ray.delta(dis(gen) / camera.fovHoriz, dis(gen) / camera.fovVert) / 180 * pi;
-					Vec3 unit = Vec3().fromAngle(rayDelta);
-					calculated += raycast(Ray(camera.pos, unit), objects, lights, maxBounces);
+					PixelStats current = { (uint32_t)samples, (float)mean, (float)squaredDiffs };
+					if (current.error() <= noiseThreshold) break;
 				}
-				calculated /= aaSamples;
-				image.setPixel(x + dX, y + dY, calculated.map(std::sqrt)); // We correct the brightness by taking the root
+
+				sampler->startPixelSample(x, y, samples);
+				// Jitter across the whole pixel for a box filter
+				double jitterX, jitterY;
+				sampler->next2D(jitterX, jitterY);
+				jitterX -= 0.5;
+				jitterY -= 0.5;
+				Vec3 dir = camera.rayDir(x + 0.5 + jitterX, y + 0.5 + jitterY);
+				Colour sample = raycast(Ray(camera.pos, dir), accel, lights, *sampler);
+				calculated += sample;
+				samples++;
+
+				double luminance = 0.2126 * sample.r + 0.7152 * sample.g + 0.0722 * sample.b;
+				double delta = luminance - mean;
+				mean += delta / samples;
+				squaredDiffs += delta * (luminance - mean);
 			}
+			rowPaths += samples - firstSample;
+			if (framebuffer) framebuffer->add(x, y, calculated, PixelStats{ (uint32_t)samples, (float)mean, (float)squaredDiffs });
+			else rowPixels.push_back(calculated / (real)samples);
+		}
+		if (stream)
+		{
+			stream->writeRow(tile.x, y, tile.width, rowPixels.data());
+			rowPixels.clear();
 		}
-		blockAssignMutex.lock();
-		std::cout << conmanip::setpos(conOffsetX + blockX * 2, conOffsetY + blockY) << "#";
-		blockAssignMutex.unlock();
+
+		progress.finishRow(tile.block, tile.width, raysTraced - reportedRays, rowPaths, pathSegments - reportedSegments);
+		reportedRays = raysTraced;
+		reportedSegments = pathSegments;
+		rowPaths = 0;
 	}
+	progress.finishedThreads++;
 }
 
 int main()
 {
+	// Kept for the headless reporter's JSON lines
+	std::streambuf* stdoutBuffer = std::cout.rdbuf();
 	std::ifstream configFile("config.json");
 	nlohmann::json config;
 	nlohmann::json cameraConfig = {
@@ -111,13 +188,6 @@ int main()
 		{"fov", 90}
 	};
 
-	conmanip::console_out_context ctxOut;
-	conmanip::console_out console(ctxOut);
-
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<> dis(0.0, 1.0);
-
 	int threadNum = 8;
 
 	int fov = 90;
@@ -129,12 +199,38 @@ int main()
 		try
 		{
 			configFile >> config;
+			// Read first so headless mode can move every message after it off stdout
+			getConfigVar<std::string>(config, "progress", progressMode);
+			if (progressMode == "headless") std::cout.rdbuf(std::cerr.rdbuf());
 			getConfigVar<int>(config, "width", width);
 			getConfigVar<int>(config, "height", height);
 			getConfigVar<int>(config, "max_bounces", maxBounces);
+			getConfigVar<int>(config, "russian_roulette_depth", rouletteDepth);
 			getConfigVar<int>(config, "block_size", blockSize);
 			getConfigVar<int>(config, "threads", threadNum);
 			getConfigVar<int>(config, "anti_aliasing_samples", aaSamples);
+			getConfigVar<int>(config, "adaptive_min_samples", minSamples);
+			getConfigVar<double>(config, "adaptive_threshold", noiseThreshold);
+			getConfigVar<int>(config, "bvh_width", bvhWidth);
+			getConfigVar<bool>(config, "deterministic", deterministic);
+			getConfigVar<uint64_t>(config, "seed", frameSeed);
+			getConfigVar<std::string>(config, "sampler", samplerType);
+			getConfigVar<std::string>(config, "scene_cache", sceneCache);
+			getConfigVar<double>(config, "progress_interval", progressInterval);
+			getConfigVar<bool>(config, "progressive", progressive);
+			getConfigVar<double>(config, "time_budget", timeBudget);
+			getConfigVar<double>(config, "noise_target", noiseTarget);
+			getConfigVar<bool>(config, "progressive_snapshots", progressiveSnapshots);
+			getConfigVar<std::string>(config, "output", outputFile);
+			getConfigVar<bool>(config, "streaming_output", streamingOutput);
+			std::string compression = exrRLE ? "rle" : "none";
+			getConfigVar<std::string>(config, "exr_compression", compression);
+			exrRLE = compression != "none";
+			std::string toneMapOperator = "clamp";
+			getConfigVar<std::string>(config, "tonemap", toneMapOperator);
+			if (!ToneMapper::parseOperator(toneMapOperator, toneMapper.op)) std::cout << "Unknown tonemap '" << toneMapOperator << "', using clamp" << std::endl;
+			getConfigVar<double>(config, "exposure", toneMapper.exposure);
+			getConfigVar<double>(config, "gamma", toneMapper.gamma);
 			getConfigVar<nlohmann::json>(config, "camera", cameraConfig);
 			getConfigVar<std::array<double, 3>>(cameraConfig, "position", camPosArr);
 			getConfigVar<std::array<double, 3>>(cameraConfig, "look_at", camDestArr);
@@ -147,68 +243,116 @@ int main()
 	}
 	else std::cout << "No config file found, using defaults" << std::endl;
 
+	if (!deterministic)
+	{
+		std::random_device rd;
+		frameSeed = ((uint64_t)rd() << 32) | rd();
+		std::cout << "Frame seed: " << frameSeed << std::endl;
+	}
+
 	Coords orig(camPosArr[0], camPosArr[1], camPosArr[2]);
 	Coords dest(camDestArr[0], camDestArr[1], camDestArr[2]);
 
-	numBlocksX = std::ceil((double)width / blockSize);
-	numBlocksY = std::ceil((double)height / blockSize);
-	numBlocks = numBlocksX * numBlocksY;
+	Scene scene;
+	scene.load(config, threadNum, bvhWidth, sceneCache);
+
+	Camera camera(orig, dest, fov, width, height);
+
+	Accelerator& accel = scene.accelerator();
+	if (scene.fromCache()) std::cout << "Using the " << accel.width() << "-wide BVH with " << accel.nodeCount() << " nodes over " << scene.objects.size() << " objects from the scene cache" << std::endl;
+	else std::cout << "Built " << accel.width() << "-wide BVH with " << accel.nodeCount() << " nodes over " << scene.objects.size() << " objects in " << accel.buildTime() << "ms" << std::endl;
+
+	ProgressReporter* reporter;
+	if (progressMode == "headless") reporter = new HeadlessReporter(progressInterval, stdoutBuffer);
+	else reporter = new ConsoleGridReporter();
 
-	Bitmap image(width, height);
+	StreamingImageWriter::Format streamFormat;
+	if (streamingOutput && !StreamingImageWriter::formatFor(outputFile, streamFormat))
+	{
+		std::cout << "Only .bmp, .ppm and .pfm output can be streamed, keeping the whole image instead" << std::endl;
+		streamingOutput = false;
+	}
+	if (streamingOutput && progressive)
+	{
+		std::cout << "Progressive rendering needs the whole image, turning off streaming output" << std::endl;
+		streamingOutput = false;
+	}
 
-	blocks = new bool[numBlocks];
-	memset(blocks, 0, numBlocks * sizeof(bool));
+	std::unique_ptr<Framebuffer> framebuffer;
+	std::unique_ptr<StreamingImageWriter> stream;
+	if (streamingOutput)
+	{
+		stream.reset(new StreamingImageWriter(width, height, blockSize, toneMapper));
+		if (!stream->open(outputFile, streamFormat)) return 1;
+	}
+	// Passes report their noise, and adaptive sampling needs each pixel's own count and error
+	else framebuffer.reset(new Framebuffer(width, height, progressive || noiseThreshold > 0.0));
 
-	conOffsetX = console.getposx();
-	conOffsetY = console.getposy();
+	std::thread* threads = new std::thread[threadNum];
 
-	for (int y = 0; y < numBlocksY; y++)
+	auto renderStart = std::chrono::steady_clock::now();
+	int samplesDone = 0;
+	int passSamples = progressive ? 1 : aaSamples;
+	for (int pass = 1; samplesDone < aaSamples; pass++)
 	{
-		for (int x = 0; x < numBlocksX; x++)
+		auto passStart = std::chrono::steady_clock::now();
+		TileScheduler scheduler(width, height, blockSize, threadNum, streamingOutput);
+		RenderProgress progress(width, height, blockSize);
+		reporter->begin(progress);
+
+		for (int thread = 0; thread < threadNum; thread++)
 		{
-			std::cout << "X ";
+			threads[thread] = std::thread(doPart, thread, framebuffer.get(), stream.get(), std::ref(camera), std::ref(accel), std::ref(scene.lights), std::ref(scheduler), std::ref(progress), passSamples);
 		}
-		std::cout << std::endl;
-	}
-	std::cout << "X: Unrendered block\n#: Rendered block\nNumber: Thread ID rendering" << std::endl;
 
-	auto matDiffuse = MatDiffuse();
-	auto matMetal = MatMetal();
-	auto matMetalFuzz = MatMetalFuzz();
-	auto matGlass = MatGlass();
+		while (progress.finishedThreads < threadNum)
+		{
+			reporter->update(progress);
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
 
-	Plane ground = Plane(Coords(0, 0, 0), Vec3(1, 1, 0));
-	Sphere sphere1 = Sphere(Coords(0, 30, 100), 30);
-	Sphere sphere2 = Sphere(Coords(30, 30, 50), 20);
-	Sphere sphere3 = Sphere(Coords(-80, 20, 175), 20);
-	Sphere sphere4 = Sphere(Coords(7, 45, 0), 10);
+		for (int thread = 0; thread < threadNum; thread++)
+		{
+			threads[thread].join();
+		}
 
-	std::vector<Object> objects;
-	objects.push_back(Object(&ground, Colour(0.6, 0.6, 0.6), &matDiffuse));
-	//objects.push_back(Object(&sphere1, Colour(1.0, 1.0, 1.0), &matMetalFuzz));
-	//objects.push_back(Object(&sphere2, Colour(1.0, 0.3, 0.3), &matDiffuse));
-	//objects.push_back(Object(&sphere3, Colour(0.7, 0.4, 0.7), &matMetal));
-	//objects.push_back(Object(&sphere4, Colour(0.6, 0.6, 1.0), &matGlass));
+		std::vector<double> idleTimes;
+		for (int thread = 0; thread < threadNum; thread++) idleTimes.push_back(scheduler.idleTime(thread));
+		reporter->end(progress, idleTimes);
 
-	std::vector<Light> lights;
-	//lights.push_back(Light(Coords(-20, 10, 50), 5, Colour(0.996, 0.773, 0.557), 100.0));
+		samplesDone += passSamples;
+		if (framebuffer) framebuffer->setSamples(samplesDone);
+		if (!progressive) break;
 
-	Camera camera(orig, dest, fov, width, height);
+		auto now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(now - renderStart).count();
+		double sampleTime = std::chrono::duration<double>(now - passStart).count() / passSamples;
+		double noise = framebuffer->noise();
+		reporter->pass(pass, samplesDone, noise, elapsed);
 
-	std::thread* threads = new std::thread[threadNum];
+		if (progressiveSnapshots) saveImage(*framebuffer);
+		if (noiseTarget > 0.0 && noise <= noiseTarget) break;
 
-	for (int thread = 0; thread < threadNum; thread++)
-	{
-		threads[thread] = std::thread(doPart, thread, std::ref(image), std::ref(camera), std::ref(objects), std::ref(lights));
+		passSamples = std::min(passSamples * 2, aaSamples - samplesDone);
+		if (timeBudget > 0.0)
+		{
+			// Shrinks the next pass to what should fit in the time left, going by how long the last one took per sample
+			double samplesLeft = (timeBudget - elapsed) / sampleTime;
+			if (samplesLeft < 1.0) break;
+			passSamples = std::min(passSamples, (int)samplesLeft);
+		}
 	}
 
-	for (int thread = 0; thread < threadNum; thread++)
+	bool saved = true;
+	if (stream)
 	{
-		threads[thread].join();
+		saved = stream->close();
+		if (saved) std::cout << "Streamed the image with at most " << stream->peakRows() << " rows in memory" << std::endl;
 	}
-
-	image.save("out.bmp");
+	else saved = saveImage(*framebuffer);
 
 	delete[] threads;
-	delete[] blocks;
+	delete reporter;
+	std::cout.rdbuf(stdoutBuffer);
+	return saved ? 0 : 1;
 }
@@ -0,0 +1,144 @@
+#include <cmath>
+#include <utility>
+
+#include "mesh.hpp"
+
+// The watertight test relies on edge functions of a shared edge coming out with exactly opposite
+// signs, which fused multiply-adds break
+#if defined(_MSC_VER)
+#pragma fp_contract (off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+TriangleRay::TriangleRay(const Ray& ray)
+{
+	double absX = std::abs(ray.dir.x);
+	double absY = std::abs(ray.dir.y);
+	double absZ = std::abs(ray.dir.z);
+	if (absX > absY && absX > absZ) kz = 0;
+	else if (absY > absZ) kz = 1;
+	else kz = 2;
+	kx = (kz + 1) % 3;
+	ky = (kx + 1) % 3;
+	// Keeps the winding of the triangle the same after the permutation
+	if (ray.dir[kz] < 0) std::swap(kx, ky);
+
+	sx = ray.dir[kx] / ray.dir[kz];
+	sy = ray.dir[ky] / ray.dir[kz];
+	sz = 1.0 / ray.dir[kz];
+}
+
+TriangleMesh::TriangleMesh(std::vector<Coords> _positions, std::vector<Vec3> _normals, std::vector<uint32_t> _indices) :
+	positions(std::move(_positions)), normals(std::move(_normals)), indices(std::move(_indices)) {}
+
+void TriangleMesh::transform(double scale, const Vec3& offset)
+{
+	for (auto& position : positions) position = position * scale + offset;
+}
+
+void TriangleMesh::build(int threads, int width)
+{
+	box = AABB();
+	std::vector<AABB> boxes(triangleCount());
+	for (int tri = 0; tri < triangleCount(); tri++)
+	{
+		for (int corner = 0; corner < 3; corner++) boxes[tri].grow(positions[indices[tri * 3 + corner]]);
+		box.grow(boxes[tri]);
+	}
+	bvh.build(boxes, threads);
+	bvh.collapse(width);
+}
+
+// Woop, Benthin and Wald's watertight test: the triangle is moved into a space where the ray
+// runs along +z from the origin, so rays crossing a shared edge always hit one of the two triangles
+bool TriangleMesh::intersectTriangle(const Ray& ray, const TriangleRay& triRay, int tri, double tMin, double& tMax, double& u, double& v)
+{
+	Vec3 a = positions[indices[tri * 3]] - ray.orig;
+	Vec3 b = positions[indices[tri * 3 + 1]] - ray.orig;
+	Vec3 c = positions[indices[tri * 3 + 2]] - ray.orig;
+
+	double ax = a[triRay.kx] - triRay.sx * a[triRay.kz];
+	double ay = a[triRay.ky] - triRay.sy * a[triRay.kz];
+	double bx = b[triRay.kx] - triRay.sx * b[triRay.kz];
+	double by = b[triRay.ky] - triRay.sy * b[triRay.kz];
+	double cx = c[triRay.kx] - triRay.sx * c[triRay.kz];
+	double cy = c[triRay.ky] - triRay.sy * c[triRay.kz];
+
+	// Scaled barycentrics, each is the signed area opposite a corner
+	double edgeU = cx * by - cy * bx;
+	double edgeV = ax * cy - ay * cx;
+	double edgeW = bx * ay - by * ax;
+	if ((edgeU < 0 || edgeV < 0 || edgeW < 0) && (edgeU > 0 || edgeV > 0 || edgeW > 0)) return false;
+
+	double det = edgeU + edgeV + edgeW;
+	if (det == 0) return false;
+
+	double az = triRay.sz * a[triRay.kz];
+	double bz = triRay.sz * b[triRay.kz];
+	double cz = triRay.sz * c[triRay.kz];
+	double t = (edgeU * az + edgeV * bz + edgeW * cz) / det;
+	if (!(t >= tMin && t < tMax)) return false;
+
+	tMax = t;
+	u = edgeV / det;
+	v = edgeW / det;
+	return true;
+}
+
+bool TriangleMesh::hit(const Ray& ray, double tMin, double& tMax, HitData& data)
+{
+	TriangleRay triRay(ray);
+	return bvh.closestHit(ray, tMax, [&](int prim, double& primTMax)
+	{
+		double u, v;
+		if (!intersectTriangle(ray, triRay, prim, tMin, primTMax, u, v)) return false;
+		data.t = primTMax;
+		data.prim = prim;
+		data.u = u;
+		data.v = v;
+		return true;
+	});
+}
+
+void TriangleMesh::surface(const Ray& ray, HitData& data)
+{
+	uint32_t i0 = indices[data.prim * 3];
+	uint32_t i1 = indices[data.prim * 3 + 1];
+	uint32_t i2 = indices[data.prim * 3 + 2];
+
+	data.pos = ray.orig + ray.dir * data.t;
+	Vec3 faceNormal = (positions[i1] - positions[i0]).cross(positions[i2] - positions[i0]).unit();
+	Vec3 shadingNormal = faceNormal;
+	if (!normals.empty())
+	{
+		shadingNormal = (normals[i0] * (1.0 - data.u - data.v) + normals[i1] * data.u + normals[i2] * data.v).unit();
+		// Vertex normals say which side is the outside when they're given, whatever the winding
+		if (faceNormal.dot(shadingNormal) < 0.0) faceNormal = -faceNormal;
+	}
+
+	// The face decides which side was hit, interpolated normals could be bent past the ray
+	data.isFront = ray.dir.dot(faceNormal) <= 0.0;
+	data.normal = data.isFront ? shadingNormal : -shadingNormal;
+}
+
+bool TriangleMesh::occludes(const Ray& ray, double tMin, double tMax)
+{
+	TriangleRay triRay(ray);
+	return bvh.anyHit(ray, tMax, [&](int prim)
+	{
+		double t = tMax;
+		double u, v;
+		return intersectTriangle(ray, triRay, prim, tMin, t, u, v);
+	});
+}
+
+bool TriangleMesh::bounds(AABB& _box)
+{
+	// An empty mesh has no box, the default one is inverted and would poison the scene BVH
+	if (triangleCount() == 0) return false;
+	_box = box;
+	return true;
+}
\ No newline at end of file
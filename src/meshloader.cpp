@@ -0,0 +1,795 @@
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cctype>
+#include <algorithm>
+
+#include "meshloader.hpp"
+#include "mappedfile.hpp"
+
+// Chunks smaller than this aren't worth starting a thread for
+const size_t MIN_CHUNK_BYTES = 1 << 20;
+const uint32_t NO_NORMAL = UINT32_MAX;
+
+// Runs work(chunk) for every chunk on its own thread, the calling thread takes chunk 0
+template<typename F> static void parallelFor(int chunks, F work)
+{
+	std::vector<std::thread> workers;
+	for (int chunk = 1; chunk < chunks; chunk++) workers.push_back(std::thread(work, chunk));
+	work(0);
+	for (auto& worker : workers) worker.join();
+}
+
+static int chunkCount(size_t bytes, int threads)
+{
+	size_t chunks = std::max(bytes / MIN_CHUNK_BYTES, (size_t)1);
+	return (int)std::min(chunks, (size_t)std::max(threads, 1));
+}
+
+/* Wavefront OBJ */
+
+enum ObjLine { OBJ_OTHER, OBJ_POSITION, OBJ_NORMAL, OBJ_FACE };
+
+// Everything in a chunk is counted in the first pass, so the second pass knows where in the mesh
+// arrays its vertices and triangles go and what negative indices are relative to
+class ObjChunk
+{
+public:
+	const char* begin;
+	const char* end;
+	size_t positions = 0, normals = 0, triangles = 0;
+	size_t positionBase = 0, normalBase = 0, triangleBase = 0;
+	std::string error; // The line that couldn't be parsed
+};
+
+static const double powersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline const char* skipSpace(const char* p, const char* end)
+{
+	while (p < end && isSpace(*p)) p++;
+	return p;
+}
+
+static inline const char* lineEnd(const char* p, const char* end)
+{
+	const char* newline = (const char*)std::memchr(p, '\n', end - p);
+	return newline != nullptr ? newline : end;
+}
+
+static inline const char* nextLine(const char* p, const char* end)
+{
+	const char* newline = lineEnd(p, end);
+	return newline < end ? newline + 1 : end;
+}
+
+// Much faster than strtod and doesn't depend on the locale, but can be off in the last bit
+static const char* parseReal(const char* p, const char* end, double& value)
+{
+	p = skipSpace(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	uint64_t mantissa = 0;
+	int digits = 0; // Significant digits in the mantissa, the rest only move the exponent
+	int exponent = 0;
+	bool anyDigits = false;
+	for (; p < end && isDigit(*p); p++)
+	{
+		anyDigits = true;
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa != 0) digits++;
+		}
+		else exponent++;
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && isDigit(*p); p++)
+		{
+			anyDigits = true;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0) digits++;
+				exponent--;
+			}
+		}
+	}
+	if (!anyDigits) return nullptr;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+		int written = 0;
+		for (; p < end && isDigit(*p); p++)
+		{
+			if (written < 10000) written = written * 10 + (*p - '0');
+		}
+		exponent += negativeExponent ? -written : written;
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0) result = exponent >= -22 ? result / powersOf10[-exponent] : result * std::pow(10.0, exponent);
+	else if (exponent > 0) result = exponent <= 22 ? result * powersOf10[exponent] : result * std::pow(10.0, exponent);
+	value = negative ? -result : result;
+	return p;
+}
+
+static const char* parseIndex(const char* p, const char* end, int64_t& value)
+{
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+	if (p == end || !isDigit(*p)) return nullptr;
+
+	int64_t result = 0;
+	for (; p < end && isDigit(*p); p++)
+	{
+		if (result < ((int64_t)1 << 40)) result = result * 10 + (*p - '0');
+	}
+	value = negative ? -result : result;
+	return p;
+}
+
+// Face corners are written v, v/vt, v//vn or v/vt/vn, normal is 0 when there isn't one
+static const char* parseCorner(const char* p, const char* end, int64_t& position, int64_t& normal)
+{
+	normal = 0;
+	p = parseIndex(p, end, position);
+	if (p == nullptr || p == end || *p != '/') return p;
+
+	p++;
+	int64_t texture;
+	if (p < end && *p != '/')
+	{
+		p = parseIndex(p, end, texture);
+		if (p == nullptr) return nullptr;
+	}
+	if (p < end && *p == '/') p = parseIndex(p + 1, end, normal);
+	return p;
+}
+
+// Moves p past the keyword at the start of the line
+static ObjLine lineType(const char*& p, const char* end)
+{
+	p = skipSpace(p, end);
+	if (end - p < 2) return OBJ_OTHER;
+	if (p[0] == 'v' && isSpace(p[1]))
+	{
+		p += 2;
+		return OBJ_POSITION;
+	}
+	if (p[0] == 'f' && isSpace(p[1]))
+	{
+		p += 2;
+		return OBJ_FACE;
+	}
+	if (end - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+	{
+		p += 3;
+		return OBJ_NORMAL;
+	}
+	return OBJ_OTHER;
+}
+
+static void countObjChunk(ObjChunk& chunk)
+{
+	for (const char* line = chunk.begin; line < chunk.end; line = nextLine(line, chunk.end))
+	{
+		const char* end = lineEnd(line, chunk.end);
+		const char* p = line;
+		switch (lineType(p, end))
+		{
+		case OBJ_POSITION:
+			chunk.positions++;
+			break;
+		case OBJ_NORMAL:
+			chunk.normals++;
+			break;
+		case OBJ_FACE:
+		{
+			int corners = 0;
+			for (p = skipSpace(p, end); p < end; p = skipSpace(p, end))
+			{
+				corners++;
+				while (p < end && !isSpace(*p)) p++;
+			}
+			// Polygons are split into a fan of triangles
+			if (corners >= 3) chunk.triangles += corners - 2;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
+
+// Turns a 1-based or negative OBJ index into a 0-based one, false if it is out of range
+static inline bool resolveIndex(int64_t index, size_t seen, size_t total, uint32_t& resolved)
+{
+	int64_t absolute = index > 0 ? index - 1 : (int64_t)seen + index;
+	if (index == 0 || absolute < 0 || absolute >= (int64_t)total) return false;
+	resolved = (uint32_t)absolute;
+	return true;
+}
+
+static void parseObjChunk(ObjChunk& chunk, TriangleMesh& mesh, std::vector<Vec3>& objNormals, std::vector<uint32_t>& cornerNormals)
+{
+	size_t position = chunk.positionBase;
+	size_t normal = chunk.normalBase;
+	size_t corner = chunk.triangleBase * 3;
+	bool hasNormals = !cornerNormals.empty();
+
+	for (const char* line = chunk.begin; line < chunk.end; line = nextLine(line, chunk.end))
+	{
+		const char* end = lineEnd(line, chunk.end);
+		const char* p = line;
+		bool valid = true;
+		ObjLine type = lineType(p, end);
+		switch (type)
+		{
+		case OBJ_POSITION:
+		case OBJ_NORMAL:
+		{
+			double x, y, z;
+			valid = (p = parseReal(p, end, x)) && (p = parseReal(p, end, y)) && (p = parseReal(p, end, z));
+			if (!valid) break;
+			if (type == OBJ_POSITION) mesh.positions[position++] = Coords(x, y, z);
+			else objNormals[normal++] = Vec3(x, y, z);
+			break;
+		}
+		case OBJ_FACE:
+		{
+			uint32_t firstPos = 0, firstNormal = 0, lastPos = 0, lastNormal = 0;
+			int corners = 0;
+			for (p = skipSpace(p, end); p < end && valid; p = skipSpace(p, end))
+			{
+				int64_t positionIndex, normalIndex;
+				p = parseCorner(p, end, positionIndex, normalIndex);
+				uint32_t pos, norm = NO_NORMAL;
+				valid = p != nullptr && (p == end || isSpace(*p)) && resolveIndex(positionIndex, position, mesh.positions.size(), pos);
+				if (valid && normalIndex != 0) valid = resolveIndex(normalIndex, normal, objNormals.size(), norm);
+				if (!valid) break;
+
+				if (corners >= 2)
+				{
+					mesh.indices[corner] = firstPos;
+					mesh.indices[corner + 1] = lastPos;
+					mesh.indices[corner + 2] = pos;
+					if (hasNormals)
+					{
+						cornerNormals[corner] = firstNormal;
+						cornerNormals[corner + 1] = lastNormal;
+						cornerNormals[corner + 2] = norm;
+					}
+					corner += 3;
+				}
+				if (corners == 0)
+				{
+					firstPos = pos;
+					firstNormal = norm;
+				}
+				lastPos = pos;
+				lastNormal = norm;
+				corners++;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+
+		if (!valid)
+		{
+			chunk.error = std::string(line, std::min(end, line + 80));
+			return;
+		}
+	}
+}
+
+static bool loadObj(const MappedFile& file, TriangleMesh& mesh, int threads, std::string& error)
+{
+	const char* fileEnd = file.data + file.size;
+	int chunks = chunkCount(file.size, threads);
+	std::vector<ObjChunk> parts(chunks);
+
+	// Chunks start at the beginning of a line so none are split between two of them
+	for (int i = 0; i < chunks; i++)
+	{
+		const char* begin = i == 0 ? file.data : nextLine(file.data + file.size / chunks * i - 1, fileEnd);
+		parts[i].begin = i > 0 && begin < parts[i - 1].begin ? parts[i - 1].begin : begin;
+	}
+	for (int i = 0; i < chunks; i++) parts[i].end = i + 1 < chunks ? parts[i + 1].begin : fileEnd;
+
+	parallelFor(chunks, [&](int chunk) { countObjChunk(parts[chunk]); });
+
+	size_t positions = 0, normals = 0, triangles = 0;
+	for (auto& part : parts)
+	{
+		part.positionBase = positions;
+		part.normalBase = normals;
+		part.triangleBase = triangles;
+		positions += part.positions;
+		normals += part.normals;
+		triangles += part.triangles;
+	}
+	if (positions > UINT32_MAX)
+	{
+		error = "too many vertices";
+		return false;
+	}
+	if (triangles == 0)
+	{
+		error = "no faces";
+		return false;
+	}
+
+	mesh.positions.resize(positions);
+	mesh.indices.resize(triangles * 3);
+	// OBJ indexes normals separately from positions, they're matched up once every face is read
+	std::vector<Vec3> objNormals(normals);
+	std::vector<uint32_t> cornerNormals(normals > 0 ? triangles * 3 : 0);
+
+	parallelFor(chunks, [&](int chunk) { parseObjChunk(parts[chunk], mesh, objNormals, cornerNormals); });
+
+	for (auto& part : parts)
+	{
+		if (!part.error.empty())
+		{
+			error = "couldn't parse line \"" + part.error + "\"";
+			return false;
+		}
+	}
+
+	if (normals == 0) return true;
+
+	// The mesh has one normal per position, which only works if each position always comes with the same normal
+	std::vector<uint32_t> positionNormals(positions, NO_NORMAL);
+	bool perVertex = true;
+	for (size_t i = 0; i < cornerNormals.size() && perVertex; i++)
+	{
+		uint32_t& assigned = positionNormals[mesh.indices[i]];
+		if (assigned == NO_NORMAL) assigned = cornerNormals[i];
+		perVertex = cornerNormals[i] != NO_NORMAL && assigned == cornerNormals[i];
+	}
+	if (!perVertex)
+	{
+		std::cout << "Normals in the OBJ aren't one per vertex, using face normals instead" << std::endl;
+		return true;
+	}
+
+	mesh.normals.resize(positions);
+	for (size_t i = 0; i < positions; i++)
+	{
+		if (positionNormals[i] != NO_NORMAL) mesh.normals[i] = objNormals[positionNormals[i]].unit();
+	}
+	return true;
+}
+
+/* Binary PLY */
+
+enum PlyType { PLY_INVALID, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+class PlyProperty
+{
+public:
+	std::string name;
+	PlyType type;
+	PlyType countType; // Only valid for list properties
+	size_t offset; // From the start of the element, for properties before any list
+};
+
+class PlyElement
+{
+public:
+	std::string name;
+	size_t count;
+	std::vector<PlyProperty> properties;
+	size_t size = 0; // Bytes per element, 0 if it has a list property
+};
+
+static PlyType plyType(const std::string& name)
+{
+	if (name == "char" || name == "int8") return PLY_INT8;
+	if (name == "uchar" || name == "uint8") return PLY_UINT8;
+	if (name == "short" || name == "int16") return PLY_INT16;
+	if (name == "ushort" || name == "uint16") return PLY_UINT16;
+	if (name == "int" || name == "int32") return PLY_INT32;
+	if (name == "uint" || name == "uint32") return PLY_UINT32;
+	if (name == "float" || name == "float32") return PLY_FLOAT32;
+	if (name == "double" || name == "float64") return PLY_FLOAT64;
+	return PLY_INVALID;
+}
+
+static int plySize(PlyType type)
+{
+	static const int sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+	return sizes[type];
+}
+
+template<typename T> static inline T readRaw(const char* p, bool swap)
+{
+	char bytes[sizeof(T)];
+	if (swap) for (size_t i = 0; i < sizeof(T); i++) bytes[i] = p[sizeof(T) - 1 - i];
+	else std::memcpy(bytes, p, sizeof(T));
+	T value;
+	std::memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+static inline double readPly(const char* p, PlyType type, bool swap)
+{
+	switch (type)
+	{
+	case PLY_INT8: return readRaw<int8_t>(p, swap);
+	case PLY_UINT8: return readRaw<uint8_t>(p, swap);
+	case PLY_INT16: return readRaw<int16_t>(p, swap);
+	case PLY_UINT16: return readRaw<uint16_t>(p, swap);
+	case PLY_INT32: return readRaw<int32_t>(p, swap);
+	case PLY_UINT32: return readRaw<uint32_t>(p, swap);
+	case PLY_FLOAT32: return readRaw<float>(p, swap);
+	case PLY_FLOAT64: return readRaw<double>(p, swap);
+	default: return 0.0;
+	}
+}
+
+static bool parsePlyHeader(const MappedFile& file, std::vector<PlyElement>& elements, bool& swap, const char*& body, std::string& error)
+{
+	const char* fileEnd = file.data + file.size;
+	const char* line = file.data;
+	bool first = true;
+	bool littleEndian = true;
+
+	while (line < fileEnd)
+	{
+		const char* end = lineEnd(line, fileEnd);
+		std::istringstream words(std::string(line, end));
+		line = nextLine(line, fileEnd);
+
+		std::string keyword;
+		words >> keyword;
+		if (first)
+		{
+			if (keyword != "ply")
+			{
+				error = "not a PLY file";
+				return false;
+			}
+			first = false;
+		}
+		else if (keyword == "format")
+		{
+			std::string format;
+			words >> format;
+			if (format == "binary_big_endian") littleEndian = false;
+			else if (format != "binary_little_endian")
+			{
+				error = "only binary PLY files are supported";
+				return false;
+			}
+		}
+		else if (keyword == "element")
+		{
+			PlyElement element;
+			words >> element.name >> element.count;
+			elements.push_back(element);
+		}
+		else if (keyword == "property")
+		{
+			if (elements.empty())
+			{
+				error = "property before any element";
+				return false;
+			}
+			PlyProperty property;
+			std::string type;
+			words >> type;
+			property.countType = PLY_INVALID;
+			if (type == "list")
+			{
+				std::string countType;
+				words >> countType >> type;
+				property.countType = plyType(countType);
+				if (property.countType == PLY_INVALID || property.countType == PLY_FLOAT32 || property.countType == PLY_FLOAT64)
+				{
+					error = "unknown list count type \"" + countType + "\"";
+					return false;
+				}
+			}
+			property.type = plyType(type);
+			words >> property.name;
+			if (property.type == PLY_INVALID)
+			{
+				error = "unknown property type \"" + type + "\"";
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+		else if (keyword == "end_header")
+		{
+			uint16_t probe = 1;
+			bool hostLittleEndian = *(char*)&probe == 1;
+			swap = littleEndian != hostLittleEndian;
+			body = line;
+
+			for (auto& element : elements)
+			{
+				size_t offset = 0;
+				bool fixed = true;
+				for (auto& property : element.properties)
+				{
+					property.offset = offset;
+					if (property.countType != PLY_INVALID) fixed = false;
+					else offset += plySize(property.type);
+				}
+				element.size = fixed ? offset : 0;
+			}
+			return true;
+		}
+	}
+
+	error = "missing end_header";
+	return false;
+}
+
+static const PlyProperty* findProperty(const PlyElement& element, const char* name)
+{
+	for (auto& property : element.properties)
+	{
+		if (property.name == name) return &property;
+	}
+	return nullptr;
+}
+
+static bool loadPlyVertices(const PlyElement& element, const char* data, bool swap, TriangleMesh& mesh, int threads, std::string& error)
+{
+	const PlyProperty* x = findProperty(element, "x");
+	const PlyProperty* y = findProperty(element, "y");
+	const PlyProperty* z = findProperty(element, "z");
+	if (x == nullptr || y == nullptr || z == nullptr)
+	{
+		error = "vertices have no x, y and z";
+		return false;
+	}
+	const PlyProperty* nx = findProperty(element, "nx");
+	const PlyProperty* ny = findProperty(element, "ny");
+	const PlyProperty* nz = findProperty(element, "nz");
+	bool hasNormals = nx != nullptr && ny != nullptr && nz != nullptr;
+
+	mesh.positions.resize(element.count);
+	if (hasNormals) mesh.normals.resize(element.count);
+
+	int chunks = chunkCount(element.count * element.size, threads);
+	parallelFor(chunks, [&](int chunk)
+	{
+		size_t begin = element.count * chunk / chunks;
+		size_t end = element.count * (chunk + 1) / chunks;
+		for (size_t i = begin; i < end; i++)
+		{
+			const char* vertex = data + i * element.size;
+			mesh.positions[i] = Coords(readPly(vertex + x->offset, x->type, swap), readPly(vertex + y->offset, y->type, swap), readPly(vertex + z->offset, z->type, swap));
+			if (hasNormals)
+			{
+				Vec3 normal(readPly(vertex + nx->offset, nx->type, swap), readPly(vertex + ny->offset, ny->type, swap), readPly(vertex + nz->offset, nz->type, swap));
+				mesh.normals[i] = normal.unit();
+			}
+		}
+	});
+	return true;
+}
+
+// Faces are variable length, but nearly every binary PLY only has triangles. Those are read in
+// parallel at a fixed stride, anything else falls back to walking the faces one at a time
+static bool loadPlyFaces(const PlyElement& element, const char* data, const char* fileEnd, bool swap, TriangleMesh& mesh, int threads, std::string& error)
+{
+	int list = -1;
+	size_t before = 0, after = 0; // Bytes of fixed size properties either side of the list
+	for (int i = 0; i < (int)element.properties.size(); i++)
+	{
+		const PlyProperty& property = element.properties[i];
+		if (property.countType != PLY_INVALID)
+		{
+			if (list != -1 || (property.name != "vertex_indices" && property.name != "vertex_index"))
+			{
+				error = "unsupported face property \"" + property.name + "\"";
+				return false;
+			}
+			list = i;
+		}
+		else if (list == -1) before += plySize(property.type);
+		else after += plySize(property.type);
+	}
+	if (list == -1)
+	{
+		error = "faces have no vertex_indices";
+		return false;
+	}
+
+	const PlyProperty& indices = element.properties[list];
+	size_t countSize = plySize(indices.countType);
+	size_t indexSize = plySize(indices.type);
+	size_t vertices = mesh.positions.size();
+	size_t stride = before + countSize + 3 * indexSize + after;
+
+	std::atomic<bool> allTriangles(element.count * stride <= (size_t)(fileEnd - data));
+	std::atomic<bool> validIndices(true);
+	if (allTriangles)
+	{
+		mesh.indices.resize(element.count * 3);
+		int chunks = chunkCount(element.count * stride, threads);
+		parallelFor(chunks, [&](int chunk)
+		{
+			size_t begin = element.count * chunk / chunks;
+			size_t end = element.count * (chunk + 1) / chunks;
+			for (size_t face = begin; face < end && allTriangles; face++)
+			{
+				const char* p = data + face * stride + before;
+				if (readPly(p, indices.countType, swap) != 3)
+				{
+					allTriangles = false;
+					break;
+				}
+				p += countSize;
+				for (int corner = 0; corner < 3; corner++, p += indexSize)
+				{
+					double index = readPly(p, indices.type, swap);
+					if (index < 0 || index >= vertices) validIndices = false;
+					mesh.indices[face * 3 + corner] = (uint32_t)index;
+				}
+			}
+		});
+	}
+
+	if (!allTriangles)
+	{
+		mesh.indices.clear();
+		validIndices = true;
+		const char* p = data;
+		for (size_t face = 0; face < element.count; face++)
+		{
+			if ((size_t)(fileEnd - p) < before + countSize)
+			{
+				error = "file is truncated";
+				return false;
+			}
+			p += before;
+			size_t count = (size_t)readPly(p, indices.countType, swap);
+			p += countSize;
+			if ((size_t)(fileEnd - p) < count * indexSize + after)
+			{
+				error = "file is truncated";
+				return false;
+			}
+
+			for (size_t corner = 0; corner < count; corner++)
+			{
+				double index = readPly(p + corner * indexSize, indices.type, swap);
+				if (index < 0 || index >= vertices) validIndices = false;
+				if (corner >= 2)
+				{
+					mesh.indices.push_back((uint32_t)readPly(p, indices.type, swap));
+					mesh.indices.push_back((uint32_t)readPly(p + (corner - 1) * indexSize, indices.type, swap));
+					mesh.indices.push_back((uint32_t)index);
+				}
+			}
+			p += count * indexSize + after;
+		}
+	}
+
+	if (!validIndices)
+	{
+		error = "face refers to a vertex that doesn't exist";
+		return false;
+	}
+	// Faces with fewer than three corners don't make any triangles
+	if (mesh.indices.empty())
+	{
+		error = "no faces";
+		return false;
+	}
+	return true;
+}
+
+static bool loadPly(const MappedFile& file, TriangleMesh& mesh, int threads, std::string& error)
+{
+	std::vector<PlyElement> elements;
+	bool swap;
+	const char* data;
+	if (!parsePlyHeader(file, elements, swap, data, error)) return false;
+
+	const char* fileEnd = file.data + file.size;
+	bool readVertices = false;
+	for (auto& element : elements)
+	{
+		if (element.name == "vertex")
+		{
+			if (element.size == 0 || element.count > UINT32_MAX || element.count * element.size > (size_t)(fileEnd - data))
+			{
+				error = "can't read the vertices";
+				return false;
+			}
+			if (!loadPlyVertices(element, data, swap, mesh, threads, error)) return false;
+			readVertices = true;
+		}
+		else if (element.name == "face")
+		{
+			if (!readVertices)
+			{
+				error = "faces come before the vertices";
+				return false;
+			}
+			// Nothing after the faces is needed, so their variable size doesn't matter
+			return loadPlyFaces(element, data, fileEnd, swap, mesh, threads, error);
+		}
+		else if (element.size == 0)
+		{
+			error = "can't skip element \"" + element.name + "\"";
+			return false;
+		}
+		data += element.count * element.size;
+	}
+
+	error = "no faces";
+	return false;
+}
+
+bool loadMesh(const std::string& path, TriangleMesh& mesh, int threads, MeshLoadStats& stats)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::string extension = path.substr(path.find_last_of('.') + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower(c); });
+	if (extension != "obj" && extension != "ply")
+	{
+		std::cout << "Unknown mesh format \"" << path << "\", only .obj and .ply are supported" << std::endl;
+		return false;
+	}
+
+	MappedFile file(path);
+	if (!file.isOpen())
+	{
+		std::cout << "Couldn't open \"" << path << "\"!" << std::endl;
+		return false;
+	}
+
+	mesh.positions.clear();
+	mesh.normals.clear();
+	mesh.indices.clear();
+
+	std::string error;
+	bool loaded = extension == "obj" ? loadObj(file, mesh, threads, error) : loadPly(file, mesh, threads, error);
+	if (!loaded)
+	{
+		std::cout << "Couldn't load \"" << path << "\": " << error << std::endl;
+		return false;
+	}
+
+	stats.bytes = file.size;
+	stats.loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include <iostream>
+
+#include "progress.hpp"
+#include "conmanip.h"
+#include "json.h"
+
+RenderProgress::RenderProgress(int width, int height, int blockSize)
+	: blocksDone(0), rowsDone(0), pixels(0), rays(0), paths(0), pathSegments(0), finishedThreads(0)
+{
+	numBlocksX = (width + blockSize - 1) / blockSize;
+	numBlocksY = (height + blockSize - 1) / blockSize;
+	numBlocks = numBlocksX * numBlocksY;
+	totalRows = numBlocksX * height;
+
+	blockStates = new std::atomic<int>[numBlocks];
+	blockRowsLeft = new std::atomic<int>[numBlocks];
+	for (int block = 0; block < numBlocks; block++)
+	{
+		int rows = height - (block / numBlocksX) * blockSize;
+		blockStates[block] = BLOCK_UNRENDERED;
+		blockRowsLeft[block] = rows < blockSize ? rows : blockSize;
+	}
+}
+
+RenderProgress::~RenderProgress()
+{
+	delete[] blockStates;
+	delete[] blockRowsLeft;
+}
+
+void RenderProgress::startBlock(int block, int thread)
+{
+	blockStates[block].store(thread, std::memory_order_relaxed);
+}
+
+void RenderProgress::finishRow(int block, int rowPixels, uint64_t rowRays, uint64_t rowPaths, uint64_t rowSegments)
+{
+	pixels.fetch_add(rowPixels, std::memory_order_relaxed);
+	rays.fetch_add(rowRays, std::memory_order_relaxed);
+	paths.fetch_add(rowPaths, std::memory_order_relaxed);
+	pathSegments.fetch_add(rowSegments, std::memory_order_relaxed);
+	rowsDone.fetch_add(1, std::memory_order_relaxed);
+	// Whichever thread finishes the last row marks the block, the release orders it after every thread's own state write
+	if (blockRowsLeft[block].fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		blockStates[block].store(BLOCK_RENDERED, std::memory_order_relaxed);
+		blocksDone.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+double RenderProgress::averagePathLength()
+{
+	uint64_t pathCount = paths.load(std::memory_order_relaxed);
+	return pathCount > 0 ? (double)pathSegments.load(std::memory_order_relaxed) / pathCount : 0.0;
+}
+
+double RenderProgress::averageSamples()
+{
+	uint64_t pixelCount = pixels.load(std::memory_order_relaxed);
+	return pixelCount > 0 ? (double)paths.load(std::memory_order_relaxed) / pixelCount : 0.0;
+}
+
+void ConsoleGridReporter::begin(RenderProgress& progress)
+{
+	conmanip::console_out_context ctxOut;
+	conmanip::console_out console(ctxOut);
+	conOffsetX = console.getposx();
+	conOffsetY = console.getposy();
+	drawnStates.assign(progress.numBlocks, BLOCK_UNRENDERED);
+
+	for (int y = 0; y < progress.numBlocksY; y++)
+	{
+		for (int x = 0; x < progress.numBlocksX; x++)
+		{
+			std::cout << "X ";
+		}
+		std::cout << std::endl;
+	}
+	std::cout << "X: Unrendered block\n#: Rendered block\nNumber: Thread ID rendering" << std::endl;
+}
+
+// Redraws the blocks whose state changed since the last call
+void ConsoleGridReporter::update(RenderProgress& progress)
+{
+	for (int block = 0; block < progress.numBlocks; block++)
+	{
+		int state = progress.blockStates[block].load(std::memory_order_relaxed);
+		if (state == drawnStates[block]) continue;
+		drawnStates[block] = state;
+
+		std::cout << conmanip::setpos(conOffsetX + (block % progress.numBlocksX) * 2, conOffsetY + block / progress.numBlocksX);
+		if (state == BLOCK_RENDERED) std::cout << "#";
+		else std::cout
+			<< conmanip::settextcolor(conmanip::console_text_colors::yellow)
+			<< state
+			<< conmanip::settextcolor(conmanip::console_text_colors::white);
+	}
+	std::cout.flush();
+}
+
+void ConsoleGridReporter::end(RenderProgress& progress, std::vector<double>& idleTimes)
+{
+	update(progress);
+	std::cout << conmanip::setpos(conOffsetX, conOffsetY + progress.numBlocksY + 4);
+	std::cout << "Average path length " << progress.averagePathLength() << " rays" << std::endl;
+	std::cout << "Average " << progress.averageSamples() << " samples per pixel" << std::endl;
+	for (int thread = 0; thread < (int)idleTimes.size(); thread++)
+	{
+		std::cout << "Thread " << thread << " idle for " << idleTimes[thread] * 1000.0 << "ms" << std::endl;
+	}
+}
+
+void ConsoleGridReporter::pass(int number, int samples, double noise, double elapsed)
+{
+	std::cout << "Pass " << number << " done, " << samples << " samples per pixel, noise " << noise << " after " << elapsed << "s" << std::endl;
+}
+
+void HeadlessReporter::begin(RenderProgress& progress)
+{
+	start = std::chrono::steady_clock::now();
+	lastReport = start;
+	report(progress, "start");
+}
+
+void HeadlessReporter::update(RenderProgress& progress)
+{
+	auto now = std::chrono::steady_clock::now();
+	if (std::chrono::duration<double>(now - lastReport).count() < interval) return;
+	lastReport = now;
+	report(progress, "progress");
+}
+
+void HeadlessReporter::end(RenderProgress& progress, std::vector<double>& idleTimes)
+{
+	report(progress, "done");
+	nlohmann::json line = {
+		{"event", "idle"},
+		{"idle_seconds", idleTimes}
+	};
+	out << line.dump() << std::endl;
+}
+
+void HeadlessReporter::pass(int number, int samples, double noise, double elapsed)
+{
+	nlohmann::json line = {
+		{"event", "pass"},
+		{"pass", number},
+		{"samples", samples},
+		{"noise", noise},
+		{"elapsed", elapsed}
+	};
+	out << line.dump() << std::endl;
+}
+
+void HeadlessReporter::report(RenderProgress& progress, const char* event)
+{
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	int rowsDone = progress.rowsDone.load(std::memory_order_relaxed);
+	uint64_t rays = progress.rays.load(std::memory_order_relaxed);
+	double fraction = (double)rowsDone / progress.totalRows;
+
+	nlohmann::json line = {
+		{"event", event},
+		{"tiles_done", progress.blocksDone.load(std::memory_order_relaxed)},
+		{"tiles_total", progress.numBlocks},
+		{"progress", fraction},
+		{"rays", rays},
+		{"rays_per_sec", elapsed > 0.0 ? rays / elapsed : 0.0},
+		{"avg_path_length", progress.averagePathLength()},
+		{"avg_samples", progress.averageSamples()},
+		{"elapsed", elapsed}
+	};
+	// Assumes the remaining rows cost about as much as the ones done so far
+	if (rowsDone > 0) line["eta"] = elapsed * (1.0 - fraction) / fraction;
+	else line["eta"] = nullptr;
+	out << line.dump() << std::endl;
+}
\ No newline at end of file
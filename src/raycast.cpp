@@ -1,13 +1,17 @@
 #include <cmath>
 #include <cassert>
 #include <iostream>
-#include <random>
+#include <limits>
 
 #include "raycast.hpp"
+#include "accelerator.hpp"
 #include "materials.hpp"
 #include "shapes.hpp"
 
-Colour mixColour(Colour a, Colour b, double weight)
+thread_local uint64_t raysTraced = 0;
+thread_local uint64_t pathSegments = 0;
+
+Colour mixColour(const Colour& a, const Colour& b, double weight)
 {
 	Colour result;
 	result.r = ((1.0 - weight) * a.r + weight * b.r);
@@ -25,124 +29,170 @@ public:
 	IntersectData(bool _hit, Coords _pos) : hit(_hit), pos(_pos) {}
 };
 
-Vec3 randInUnitSphere()
+Vec3 randInUnitSphere(Sampler& sampler)
 {
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<> dis(-1.0, 1.0);
-
 	double x, y, z;
 	do
 	{
-		x = dis(gen);
-		y = dis(gen);
-		z = dis(gen);
-	} while (std::pow(x, 2) + std::pow(y, 2) + std::pow(z, 2) > 1);
+		x = sampler.uniform(-1.0, 1.0);
+		y = sampler.uniform(-1.0, 1.0);
+		z = sampler.uniform(-1.0, 1.0);
+	} while (x * x + y * y + z * z > 1);
 
 	return Vec3(x, y, z);
 }
 
-Vec3 randomInUnitDisk() {
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<> dis(-1.0, 1.0);
+// Uniform point on the unit disk pushed up onto the hemisphere around the normal
+Vec3 cosineHemisphere(const Vec3& normal, Sampler& sampler, double& pdf)
+{
+	// The basis is only orthonormal around a unit normal, otherwise samples end up below the surface
+	assert(std::abs(normal.lengthSquared() - 1.0) < 1e-4);
+	double radiusSquared, turn;
+	sampler.next2D(radiusSquared, turn);
+	double phi = 2.0 * pi * turn;
+	double radius = std::sqrt(radiusSquared);
+	double x = radius * std::cos(phi);
+	double y = radius * std::sin(phi);
+	double z = std::sqrt(1.0 - radiusSquared);
+
+	Vec3 tangent, bitangent;
+	normal.basis(tangent, bitangent);
+
+	pdf = z / pi;
+	return tangent * x + bitangent * y + normal * z;
+}
+
+Vec3 randomInUnitDisk(Sampler& sampler) {
 	while (true) {
-		auto p = Vec3(dis(gen), dis(gen), 0);
-		if (std::pow(p.length(), 2) >= 1) continue;
+		auto p = Vec3(sampler.uniform(-1.0, 1.0), sampler.uniform(-1.0, 1.0), 0);
+		if (p.lengthSquared() >= 1) continue;
 		return p;
 	}
 }
 
-bool clearPath(Ray ray, double dist, std::vector<Object>& objects)
+// tMax is in multiples of the ray direction, so an unnormalised direction to the target can use 1
+bool clearPath(const Ray& ray, double tMax, Accelerator& accel)
+{
+	raysTraced++;
+	return !accel.occluded(ray, tMax);
+}
+
+// Veach's power heuristic with an exponent of 2, the weight for a sample taken with pdf when the other strategy has otherPdf
+static double powerHeuristic(double pdf, double otherPdf)
 {
-	for (auto& obj : objects)
+	double squared = pdf * pdf;
+	return squared / (squared + otherPdf * otherPdf);
+}
+
+// Next event estimation: one light picked uniformly, a direction towards it picked by its shape and a shadow ray
+// to check nothing is in the way. The result still has to be multiplied by the surface colour
+static Colour sampleLight(const Ray& ray, const HitData& hitData, Material* mat, Accelerator& accel, std::vector<Light>& lights, Sampler& sampler)
+{
+	size_t index = std::min((size_t)(sampler.next1D() * lights.size()), lights.size() - 1);
+	Light& light = lights[index];
+
+	Vec3 dir;
+	double lightPdf = light.obj.shape->sampleDirection(hitData.pos, sampler, dir);
+	if (lightPdf <= 0.0) return Colour(0, 0, 0);
+	lightPdf /= lights.size();
+
+	double bsdfPdf;
+	double value = mat->evaluate(ray, hitData, dir, bsdfPdf);
+	if (value <= 0.0) return Colour(0, 0, 0);
+
+	Ray shadow(hitData.pos, dir);
+	HitData lightHit;
+	double tLight = std::numeric_limits<double>::infinity();
+	if (!light.obj.shape->hit(shadow, IMPRECISION_DELTA, tLight, lightHit)) return Colour(0, 0, 0);
+	if (!clearPath(shadow, tLight, accel)) return Colour(0, 0, 0);
+	// Lights aren't in the BVH but still block each other, the same as they do for bounce rays
+	for (size_t other = 0; other < lights.size(); other++)
 	{
-		HitData hitData;
-		bool hit = obj.shape->hit(ray, hitData);
-		if (hit && ray.orig.dist(hitData.pos) < dist) return false;
+		if (other != index && lights[other].obj.shape->occludes(shadow, IMPRECISION_DELTA, tLight)) return Colour(0, 0, 0);
 	}
-	return true;
+
+	return light.obj.col * (light.intensity * value * powerHeuristic(lightPdf, bsdfPdf) / lightPdf);
 }
 
-Colour raycast(Ray ray, std::vector<Object>& objects, std::vector<Light>& lights, int depth)
+Colour raycast(const Ray& cameraRay, Accelerator& accel, std::vector<Light>& lights, Sampler& sampler)
 {
-	if (depth == 0) return Colour(0, 0, 0);
-
-	Colour hitColour;
+	Colour radiance(0, 0, 0);
+	// What light found at the current vertex gets multiplied by on its way back to the camera
+	Colour throughput(1.0, 1.0, 1.0);
+	Ray ray = cameraRay;
+	// Where the current ray was bounced from and the pdf it was picked with, 0 for camera rays and specular bounces
+	// which light sampling can't reproduce
+	Coords bouncePos;
+	double bouncePdf = 0.0;
+
+	for (int bounce = 0; bounce < maxBounces; bounce++)
+	{
+		sampler.startBounce(bounce);
+		raysTraced++;
+		pathSegments++;
 
-	bool isLightSource = false;
-	double intensity = 0;
-	bool hit = false;
-	double nearest;
-	Colour col;
-	Material* mat = NULL;
+		double nearest = std::numeric_limits<double>::infinity();
+		HitData hitData;
+		Object* obj = NULL;
+		Light* hitLight = NULL;
 
-	HitData hitData;
+		accel.intersect(ray, nearest, hitData, obj);
 
-	for (auto& obj : objects)
-	{
-		HitData testHit;
-		bool hitObj = obj.shape->hit(ray, testHit);
-		if (hitObj)
+		for (auto& light : lights)
 		{
-			if (!hit || ray.orig.dist(testHit.pos) < nearest)
+			if (light.obj.shape->hit(ray, IMPRECISION_DELTA, nearest, hitData))
 			{
-				hit = true;
-				hitData = testHit;
-				nearest = ray.orig.dist(testHit.pos);
-				col = obj.col;
-				mat = obj.mat;
+				obj = &light.obj;
+				hitLight = &light;
 			}
 		}
-	}
 
-	for (auto& light : lights)
-	{
-		bool hitObj = light.obj.shape->hit(ray, hitData);
-		if(hitObj)
+		if (obj == NULL)
 		{
-			if (!hit || ray.orig.dist(hitData.pos) < nearest)
-			{
-				hit = true;
-				nearest = ray.orig.dist(hitData.pos);
-				isLightSource = true;
-				col = light.obj.col;
-				intensity = light.intensity;
-			}
+			radiance += throughput * Colour(0.8, 0.8, 0.9);
+			break;
 		}
-	}
 
-	if (hit)
-	{
-		Colour calculated;
-		if (isLightSource)
+		if (hitLight != NULL)
 		{
-			// Hacky way to do it but it looks good and I can't find any other way
-			calculated = Colour(1.0, 1.0, 1.0) - col.inverse() / std::sqrt(intensity);
-		}
-		else
-		{
-			double attenuation = mat->attenuation();
-			Ray bounce = mat->bounce(ray, hitData);
-			calculated = raycast(bounce, objects, lights, depth - 1);
-			// This makes the material attenuate the light ray in a realistic way
-			//calculated -= col.inverse() * attenuation;
-			calculated *= col;
-		}
-		for (auto& light : lights)
-		{
-			HitData lightHit;
-			Ray test(hitData.pos, hitData.normal);
-			bool lightIntersect = light.obj.shape->hit(test, lightHit);
-			if (clearPath(Ray(hitData.pos, (lightHit.pos - hitData.pos).unit()), hitData.pos.dist(lightHit.pos), objects))
+			// Weighted against the chance sampleLight() had of picking the same direction from the last bounce
+			double weight = 1.0;
+			if (bouncePdf > 0.0)
 			{
-				Vec3 toLight = lightHit.pos - hitData.pos;
-				double dot = std::max(0.0, hitData.normal.dot(toLight.unit()));
-				double contribution = std::min(dot * light.intensity / std::pow(toLight.length(), 2), 1.0);
-				calculated += light.obj.col * contribution;
+				double lightPdf = hitLight->obj.shape->directionPdf(bouncePos, ray.dir.unit()) / lights.size();
+				weight = powerHeuristic(bouncePdf, lightPdf);
 			}
+			radiance += throughput * hitLight->obj.col * (hitLight->intensity * weight);
+			break;
+		}
+
+		// Only the closest hit gets its position and normal worked out
+		obj->shape->surface(ray, hitData);
+		Material* mat = obj->mat;
+		if (!lights.empty()) radiance += throughput * obj->col * sampleLight(ray, hitData, mat, accel, lights, sampler);
+
+		BSDFSample next = mat->bounce(ray, hitData, sampler);
+#ifndef NDEBUG
+		// MIS weighs light samples by evaluate()'s pdf and bounces by bounce()'s, they have to be the same density
+		double evaluatedPdf;
+		mat->evaluate(ray, hitData, next.ray.dir, evaluatedPdf);
+		assert(std::abs(evaluatedPdf - next.pdf) <= 1e-4 * next.pdf);
+#endif
+		bouncePos = hitData.pos;
+		bouncePdf = next.pdf;
+		ray = next.ray;
+		// This makes the material attenuate the light ray in a realistic way
+		//throughput -= obj->col.inverse() * mat->attenuation();
+		throughput *= obj->col;
+
+		// Russian roulette: past the minimum depth, paths carrying little light are likely to be ended
+		// and the ones that carry on are weighted up by the same amount so the estimate stays unbiased
+		if (bounce >= rouletteDepth)
+		{
+			double survival = std::fmin(std::fmax(std::fmax(throughput.r, throughput.g), throughput.b), 1.0);
+			if (sampler.next1D() >= survival) break;
+			throughput /= survival;
 		}
-		return calculated;
 	}
-	return Colour(0.8, 0.8, 0.9);
+	return radiance;
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "sampler.hpp"
+
+static uint32_t reverseBits(uint32_t value)
+{
+	value = (value << 16) | (value >> 16);
+	value = ((value & 0x00ff00ffu) << 8) | ((value & 0xff00ff00u) >> 8);
+	value = ((value & 0x0f0f0f0fu) << 4) | ((value & 0xf0f0f0f0u) >> 4);
+	value = ((value & 0x33333333u) << 2) | ((value & 0xccccccccu) >> 2);
+	value = ((value & 0x55555555u) << 1) | ((value & 0xaaaaaaaau) >> 1);
+	return value;
+}
+
+// Laine and Karras' hash, each bit only depends on the bits below it
+static uint32_t laineKarrasPermutation(uint32_t value, uint32_t seed)
+{
+	value += seed;
+	value ^= value * 0x6c50b47cu;
+	value ^= value * 0xb82f1e52u;
+	value ^= value * 0xc7afe638u;
+	value ^= value * 0x8d22f6e6u;
+	return value;
+}
+
+// Owen scrambling, each bit flipped depending on the bits above it
+static uint32_t nestedUniformScramble(uint32_t value, uint32_t seed)
+{
+	return reverseBits(laineKarrasPermutation(reverseBits(value), seed));
+}
+
+// First two Sobol dimensions, the van der Corput sequence and the one from the polynomial x + 1
+static uint32_t sobol0(uint32_t index)
+{
+	return reverseBits(index);
+}
+
+static uint32_t sobol1(uint32_t index)
+{
+	uint32_t result = 0;
+	for (uint32_t direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1)
+	{
+		if (index & 1) result ^= direction;
+	}
+	return result;
+}
+
+// Interleaves the bits of x and y, so pixels close on screen get indices close together
+static uint32_t morton(uint32_t x, uint32_t y)
+{
+	uint64_t bits = ((uint64_t)y << 32) | x;
+	bits = (bits | (bits << 8)) & 0x00ff00ff00ff00ffULL;
+	bits = (bits | (bits << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	bits = (bits | (bits << 2)) & 0x3333333333333333ULL;
+	bits = (bits | (bits << 1)) & 0x5555555555555555ULL;
+	return (uint32_t)(bits | (bits >> 31));
+}
+
+SobolSampler::SobolSampler(uint64_t _frameSeed, bool _zOrder, int samplesPerPixel)
+	: Sampler(_frameSeed), zOrder(_zOrder), sampleBits(0), index(0), pixelSeed(0), bounceSeed(0), pairSeed(0), pairIndex(0), dimension(0)
+{
+	while ((1 << sampleBits) < samplesPerPixel) sampleBits++;
+}
+
+void SobolSampler::startPixelSample(int x, int y, int sample)
+{
+	if (zOrder)
+	{
+		// One sequence over the whole image, the scrambles are the same for every pixel.
+		// Indices wrap past 32 bits, which only happens at 4K with hundreds of samples per pixel
+		pixelSeed = mix(frameSeed);
+		index = (morton((uint32_t)x & 0xffff, (uint32_t)y & 0xffff) << sampleBits) | (uint32_t)sample;
+	}
+	else
+	{
+		uint64_t pixel = ((uint64_t)(uint32_t)y << 32) | (uint32_t)x;
+		pixelSeed = mix(frameSeed ^ mix(pixel));
+		index = (uint32_t)sample;
+	}
+	bounceSeed = mix(pixelSeed);
+	dimension = 0;
+}
+
+void SobolSampler::startBounce(int bounce)
+{
+	bounceSeed = mix(pixelSeed ^ (uint32_t)(bounce + 1));
+	dimension = 0;
+}
+
+double SobolSampler::next1D()
+{
+	if (dimension % 2 == 0) startPair();
+	uint32_t value = dimension % 2 == 0 ? sobol0(pairIndex) : sobol1(pairIndex);
+	value = nestedUniformScramble(value, (uint32_t)mix(pairSeed + dimension % 2));
+	dimension++;
+	return value * (1.0 / 4294967296.0);
+}
+
+void SobolSampler::next2D(double& u, double& v)
+{
+	if (dimension % 2 != 0) dimension++;
+	u = next1D();
+	v = next1D();
+}
+
+// Shuffling the index per pair keeps the pairs from being correlated with each other. The shuffle is an Owen
+// scramble too, so a pixel's samples stay one aligned block of the sequence and neighbouring pixels stay neighbours
+void SobolSampler::startPair()
+{
+	pairSeed = (uint32_t)mix(bounceSeed ^ (uint32_t)(dimension / 2));
+	pairIndex = nestedUniformScramble(index, pairSeed);
+}
\ No newline at end of file
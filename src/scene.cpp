@@ -0,0 +1,179 @@
+#include <iostream>
+#include <array>
+
+#include "scene.hpp"
+#include "shapes.hpp"
+#include "materials.hpp"
+#include "mesh.hpp"
+#include "meshloader.hpp"
+#include "mappedfile.hpp"
+#include "scenecache.hpp"
+
+static Coords readCoords(const nlohmann::json& value)
+{
+	std::array<double, 3> coords = value;
+	return Coords(coords[0], coords[1], coords[2]);
+}
+
+static Colour readColour(const nlohmann::json& entry)
+{
+	std::array<double, 3> colour = entry.value("colour", std::array<double, 3>{0.8, 0.8, 0.8});
+	return Colour(colour[0], colour[1], colour[2]);
+}
+
+Scene::Scene()
+{
+	materials["diffuse"] = std::unique_ptr<Material>(new MatDiffuse());
+	materials["metal"] = std::unique_ptr<Material>(new MatMetal());
+	materials["metal_fuzz"] = std::unique_ptr<Material>(new MatMetalFuzz());
+	materials["glass"] = std::unique_ptr<Material>(new MatGlass());
+}
+
+Scene::~Scene() {}
+
+void Scene::load(const nlohmann::json& config, int threads, int bvhWidth, const std::string& cachePath)
+{
+	uint64_t hash = SceneCache::hash(config, bvhWidth);
+	if (!cachePath.empty() && SceneCache::read(cachePath, hash, *this)) return;
+
+	// Materials go first so objects can refer to them by name
+	if (config.contains("materials")) loadMaterials(config["materials"]);
+	if (config.contains("objects")) loadObjects(config["objects"]);
+	if (config.contains("meshes")) loadMeshes(config["meshes"], threads, bvhWidth);
+	if (config.contains("lights")) loadLights(config["lights"]);
+
+	accel.reset(new Accelerator(objects, threads, bvhWidth));
+
+	if (!cachePath.empty()) SceneCache::write(cachePath, hash, *this);
+}
+
+// "name": {"type": "diffuse" | "metal" | "metal_fuzz" | "glass", "fuzz": 0.2, "refractive_index": 1.33}
+void Scene::loadMaterials(const nlohmann::json& section)
+{
+	for (auto it = section.begin(); it != section.end(); ++it)
+	{
+		try
+		{
+			std::string type = it.value().at("type");
+			Material* mat;
+			if (type == "diffuse") mat = new MatDiffuse();
+			else if (type == "metal") mat = new MatMetal();
+			else if (type == "metal_fuzz") mat = new MatMetalFuzz(it.value().value("fuzz", 0.2));
+			else if (type == "glass") mat = new MatGlass(it.value().value("refractive_index", 1.33));
+			else
+			{
+				std::cout << "Unknown type '" << type << "' for material '" << it.key() << "', skipping it" << std::endl;
+				continue;
+			}
+			materials[it.key()] = std::unique_ptr<Material>(mat);
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Malformed material '" << it.key() << "', skipping it" << std::endl;
+		}
+	}
+}
+
+// {"type": "sphere", "position": [x, y, z], "radius": r} or {"type": "plane", "point": [x, y, z], "normal": [x, y, z]},
+// both with "colour", "material" and optionally "enabled": false to leave them out
+void Scene::loadObjects(const nlohmann::json& section)
+{
+	for (auto& entry : section)
+	{
+		try
+		{
+			if (!entry.value("enabled", true)) continue;
+			std::string type = entry.at("type");
+			Shape* shape;
+			if (type == "sphere") shape = new Sphere(readCoords(entry.at("position")), entry.at("radius"));
+			else if (type == "plane")
+			{
+				Coords normal = readCoords(entry.at("normal"));
+				if (normal.lengthSquared() == 0.0)
+				{
+					std::cout << "Plane with a zero normal, skipping it" << std::endl;
+					continue;
+				}
+				shape = new Plane(readCoords(entry.at("point")), normal);
+			}
+			else
+			{
+				std::cout << "Unknown object type '" << type << "', skipping it" << std::endl;
+				continue;
+			}
+			shapes.push_back(std::unique_ptr<Shape>(shape));
+			objects.push_back(Object(shape, readColour(entry), material(entry.value("material", std::string("diffuse")))));
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Malformed object entry, skipping it" << std::endl;
+		}
+	}
+}
+
+// {"file": "model.obj", "position": [x, y, z], "scale": s, "colour": [r, g, b], "material": "name"}
+void Scene::loadMeshes(const nlohmann::json& section, int threads, int bvhWidth)
+{
+	for (auto& entry : section)
+	{
+		std::string file;
+		Coords position;
+		double scale;
+		Colour colour;
+		std::string materialName;
+		try
+		{
+			file = entry.at("file");
+			position = readCoords(entry.value("position", nlohmann::json::array({0, 0, 0})));
+			scale = entry.value("scale", 1.0);
+			colour = readColour(entry);
+			materialName = entry.value("material", std::string("diffuse"));
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Malformed mesh entry, skipping it" << std::endl;
+			continue;
+		}
+
+		std::unique_ptr<TriangleMesh> mesh(new TriangleMesh());
+		MeshLoadStats stats;
+		if (!loadMesh(file, *mesh, threads, stats)) continue;
+		if (mesh->triangleCount() == 0)
+		{
+			std::cout << "\"" << file << "\" has no triangles, skipping it" << std::endl;
+			continue;
+		}
+		std::cout << "Loaded " << mesh->triangleCount() << " triangles from \"" << file << "\" in " << stats.loadTime << "ms (" << stats.throughput() << " MB/s)" << std::endl;
+
+		mesh->transform(scale, position);
+		mesh->build(threads, bvhWidth);
+		objects.push_back(Object(mesh.get(), colour, material(materialName)));
+		shapes.push_back(std::move(mesh));
+	}
+}
+
+// {"position": [x, y, z], "radius": r, "colour": [r, g, b], "intensity": i}, the sphere gives off colour * intensity
+void Scene::loadLights(const nlohmann::json& section)
+{
+	for (auto& entry : section)
+	{
+		try
+		{
+			Shape* shape = new Sphere(readCoords(entry.at("position")), entry.at("radius"));
+			shapes.push_back(std::unique_ptr<Shape>(shape));
+			lights.push_back(Light{ Object(shape, readColour(entry), nullptr), entry.at("intensity") });
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Malformed light entry, skipping it" << std::endl;
+		}
+	}
+}
+
+Material* Scene::material(const std::string& name)
+{
+	auto found = materials.find(name);
+	if (found != materials.end()) return found->second.get();
+	std::cout << "Unknown material '" << name << "', using diffuse" << std::endl;
+	return materials["diffuse"].get();
+}
\ No newline at end of file
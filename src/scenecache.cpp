@@ -0,0 +1,590 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "scenecache.hpp"
+#include "scene.hpp"
+#include "shapes.hpp"
+#include "materials.hpp"
+#include "mesh.hpp"
+#include "mappedfile.hpp"
+
+// Arrays start on this boundary in the file so they can be used in place once it is mapped
+const size_t CACHE_ALIGNMENT = 64;
+const char CACHE_MAGIC[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', 0 };
+
+enum CacheMaterial { CACHE_DIFFUSE, CACHE_METAL, CACHE_METAL_FUZZ, CACHE_GLASS };
+enum CacheShape { CACHE_SPHERE, CACHE_PLANE, CACHE_MESH };
+
+// Sizes of everything that is used in place, a build with other settings (float reals, aligned vectors)
+// lays them out differently and has to rebuild the cache
+class CacheHeader
+{
+public:
+	char magic[8];
+	uint32_t version;
+	uint32_t endianness;
+	uint32_t vecSize, nodeSize, wide4Size, wide8Size;
+	uint64_t hash;
+};
+
+class CacheArray
+{
+public:
+	uint64_t count;
+	uint64_t elementSize;
+	char padding[CACHE_ALIGNMENT - 2 * sizeof(uint64_t)];
+};
+
+class CacheMaterialRecord
+{
+public:
+	uint32_t type;
+	double parameter; // Fuzz or refractive index
+};
+
+class CacheObjectRecord
+{
+public:
+	uint32_t shapeType;
+	uint32_t shape; // Index into the spheres, planes or meshes of the cache
+	int32_t material; // -1 for none
+	double colour[3];
+};
+
+class CacheSphereRecord
+{
+public:
+	double centre[3];
+	double radius;
+};
+
+class CachePlaneRecord
+{
+public:
+	double point[3];
+	double normal[3];
+};
+
+class CacheLightRecord
+{
+public:
+	double centre[3];
+	double radius;
+	double colour[3];
+	double intensity;
+};
+
+class CacheBVHRecord
+{
+public:
+	uint32_t width;
+};
+
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t SceneCache::hash(const nlohmann::json& config, int bvhWidth)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = fnv1a(&SCENE_CACHE_VERSION, sizeof(SCENE_CACHE_VERSION), hash);
+	hash = fnv1a(&bvhWidth, sizeof(bvhWidth), hash);
+
+	const char* sections[] = { "materials", "objects", "meshes", "lights" };
+	for (const char* section : sections)
+	{
+		std::string text = config.contains(section) ? config[section].dump() : "null";
+		hash = fnv1a(text.data(), text.size(), hash);
+	}
+
+	// Hashing the mesh files themselves would cost about as much as loading them
+	if (config.contains("meshes") && config["meshes"].is_array())
+	{
+		for (auto& entry : config["meshes"])
+		{
+			if (!entry.is_object() || !entry.contains("file") || !entry["file"].is_string()) continue;
+			std::string file = entry["file"];
+			struct stat info;
+			if (stat(file.c_str(), &info) != 0) continue;
+			int64_t size = (int64_t)info.st_size;
+			int64_t modified = (int64_t)info.st_mtime;
+			hash = fnv1a(&size, sizeof(size), hash);
+			hash = fnv1a(&modified, sizeof(modified), hash);
+		}
+	}
+	return hash;
+}
+
+/* Writing */
+
+class CacheWriter
+{
+public:
+	std::ofstream file;
+	size_t offset = 0;
+
+	CacheWriter(const std::string& path) : file(path, std::ios::out | std::ios::binary | std::ios::trunc) {}
+
+	template<typename T> void array(const T* items, size_t count)
+	{
+		CacheArray header;
+		std::memset(&header, 0, sizeof(header));
+		header.count = count;
+		header.elementSize = sizeof(T);
+		bytes(&header, sizeof(header));
+		bytes(items, count * sizeof(T));
+	}
+
+	template<typename T> void record(const T& item)
+	{
+		array(&item, 1);
+	}
+
+	template<typename T> void buffer(const Buffer<T>& items)
+	{
+		array(items.data(), items.size());
+	}
+
+	void bvh(const BVH& tree)
+	{
+		CacheBVHRecord header = {};
+		header.width = tree.width;
+		record(header);
+		buffer(tree.nodes);
+		buffer(tree.indices);
+		buffer(tree.nodes4);
+		buffer(tree.nodes8);
+	}
+
+private:
+	void bytes(const void* data, size_t size)
+	{
+		static const char zeros[CACHE_ALIGNMENT] = {};
+		if (size > 0) file.write((const char*)data, size);
+		offset += size;
+		size_t padding = (CACHE_ALIGNMENT - offset % CACHE_ALIGNMENT) % CACHE_ALIGNMENT;
+		file.write(zeros, padding);
+		offset += padding;
+	}
+};
+
+static void writeCoords(const Coords& coords, double* out)
+{
+	out[0] = coords.x;
+	out[1] = coords.y;
+	out[2] = coords.z;
+}
+
+static void writeColour(const Colour& colour, double* out)
+{
+	out[0] = colour.r;
+	out[1] = colour.g;
+	out[2] = colour.b;
+}
+
+bool SceneCache::write(const std::string& path, uint64_t hash, Scene& scene)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<char> names;
+	std::vector<CacheMaterialRecord> materials;
+	std::map<Material*, int32_t> materialIndices;
+	for (auto& entry : scene.materials)
+	{
+		CacheMaterialRecord record = {};
+		Material* mat = entry.second.get();
+		if (dynamic_cast<MatDiffuse*>(mat)) record.type = CACHE_DIFFUSE;
+		else if (dynamic_cast<MatMetal*>(mat)) record.type = CACHE_METAL;
+		else if (MatMetalFuzz* fuzz = dynamic_cast<MatMetalFuzz*>(mat))
+		{
+			record.type = CACHE_METAL_FUZZ;
+			record.parameter = fuzz->perturbation;
+		}
+		else if (MatGlass* glass = dynamic_cast<MatGlass*>(mat))
+		{
+			record.type = CACHE_GLASS;
+			record.parameter = glass->refractiveIndex;
+		}
+		else
+		{
+			std::cout << "Can't cache material '" << entry.first << "', not writing the scene cache" << std::endl;
+			return false;
+		}
+		materialIndices[mat] = (int32_t)materials.size();
+		materials.push_back(record);
+		names.insert(names.end(), entry.first.begin(), entry.first.end());
+		names.push_back('\0');
+	}
+
+	std::vector<CacheObjectRecord> objects;
+	std::vector<CacheSphereRecord> spheres;
+	std::vector<CachePlaneRecord> planes;
+	std::vector<TriangleMesh*> meshes;
+	for (auto& object : scene.objects)
+	{
+		CacheObjectRecord record = {};
+		writeColour(object.col, record.colour);
+		record.material = object.mat != nullptr ? materialIndices[object.mat] : -1;
+
+		if (Sphere* sphere = dynamic_cast<Sphere*>(object.shape))
+		{
+			record.shapeType = CACHE_SPHERE;
+			record.shape = (uint32_t)spheres.size();
+			CacheSphereRecord shape = {};
+			writeCoords(sphere->pos, shape.centre);
+			shape.radius = sphere->rad;
+			spheres.push_back(shape);
+		}
+		else if (Plane* plane = dynamic_cast<Plane*>(object.shape))
+		{
+			record.shapeType = CACHE_PLANE;
+			record.shape = (uint32_t)planes.size();
+			CachePlaneRecord shape = {};
+			writeCoords(plane->point, shape.point);
+			writeCoords(plane->normal, shape.normal);
+			planes.push_back(shape);
+		}
+		else if (TriangleMesh* mesh = dynamic_cast<TriangleMesh*>(object.shape))
+		{
+			record.shapeType = CACHE_MESH;
+			record.shape = (uint32_t)meshes.size();
+			meshes.push_back(mesh);
+		}
+		else
+		{
+			std::cout << "Can't cache a shape in the scene, not writing the scene cache" << std::endl;
+			return false;
+		}
+		objects.push_back(record);
+	}
+
+	std::vector<CacheLightRecord> lights;
+	for (auto& light : scene.lights)
+	{
+		Sphere* sphere = dynamic_cast<Sphere*>(light.obj.shape);
+		if (sphere == nullptr)
+		{
+			std::cout << "Can't cache a light in the scene, not writing the scene cache" << std::endl;
+			return false;
+		}
+		CacheLightRecord record = {};
+		writeCoords(sphere->pos, record.centre);
+		record.radius = sphere->rad;
+		writeColour(light.obj.col, record.colour);
+		record.intensity = light.intensity;
+		lights.push_back(record);
+	}
+
+	// Written next to the cache and renamed over it, so an interrupted write never leaves a broken cache behind
+	std::string tempPath = path + ".tmp";
+	size_t size;
+	{
+		CacheWriter writer(tempPath);
+		if (!writer.file.is_open())
+		{
+			std::cout << "Couldn't open \"" << tempPath << "\"!" << std::endl;
+			return false;
+		}
+
+		CacheHeader header = {};
+		std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		header.version = SCENE_CACHE_VERSION;
+		header.endianness = 0x01020304;
+		header.vecSize = sizeof(Vec3);
+		header.nodeSize = sizeof(BVHNode);
+		header.wide4Size = sizeof(WideNode<4>);
+		header.wide8Size = sizeof(WideNode<8>);
+		header.hash = hash;
+		writer.record(header);
+
+		writer.array(names.data(), names.size());
+		writer.array(materials.data(), materials.size());
+		writer.array(spheres.data(), spheres.size());
+		writer.array(planes.data(), planes.size());
+		writer.record((uint64_t)meshes.size());
+		for (TriangleMesh* mesh : meshes)
+		{
+			writer.record(mesh->box);
+			writer.buffer(mesh->positions);
+			writer.buffer(mesh->normals);
+			writer.buffer(mesh->indices);
+			writer.bvh(mesh->bvh);
+		}
+		writer.array(objects.data(), objects.size());
+		writer.array(lights.data(), lights.size());
+		writer.bvh(scene.accel->bvh);
+
+		writer.file.close();
+		if (writer.file.fail())
+		{
+			std::cout << "Couldn't write \"" << tempPath << "\"!" << std::endl;
+			std::remove(tempPath.c_str());
+			return false;
+		}
+		size = writer.offset;
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		std::cout << "Couldn't replace \"" << path << "\"!" << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Wrote scene cache \"" << path << "\" (" << size / 1e6 << " MB) in " << time << "ms" << std::endl;
+	return true;
+}
+
+/* Reading */
+
+class CacheReader
+{
+public:
+	const char* cursor;
+	const char* end;
+	bool ok = true;
+
+	CacheReader(const MappedFile& file) : cursor(file.data), end(file.data + file.size) {}
+
+	// Points at count elements in the mapped file, null and not ok if the file doesn't have them
+	template<typename T> const T* array(size_t& count)
+	{
+		count = 0;
+		if (!ok || (size_t)(end - cursor) < sizeof(CacheArray)) return fail<T>();
+		CacheArray header;
+		std::memcpy(&header, cursor, sizeof(header));
+		cursor += sizeof(header);
+
+		if (header.elementSize != sizeof(T) || header.count > (size_t)(end - cursor) / sizeof(T)) return fail<T>();
+		const T* items = (const T*)cursor;
+		size_t size = (size_t)header.count * sizeof(T);
+		size += (CACHE_ALIGNMENT - size % CACHE_ALIGNMENT) % CACHE_ALIGNMENT;
+		if (size > (size_t)(end - cursor)) return fail<T>();
+		cursor += size;
+		count = (size_t)header.count;
+		return items;
+	}
+
+	template<typename T> bool record(T& item)
+	{
+		size_t count;
+		const T* items = array<T>(count);
+		if (count != 1) return fail<T>() != nullptr;
+		item = items[0];
+		return true;
+	}
+
+	template<typename T> void buffer(Buffer<T>& items)
+	{
+		size_t count;
+		const T* data = array<T>(count);
+		if (ok) items.borrow(data, count);
+	}
+
+	void bvh(BVH& tree)
+	{
+		CacheBVHRecord header;
+		if (!record(header)) return;
+		tree.width = (int)header.width;
+		buffer(tree.nodes);
+		buffer(tree.indices);
+		buffer(tree.nodes4);
+		buffer(tree.nodes8);
+	}
+
+private:
+	template<typename T> const T* fail()
+	{
+		ok = false;
+		return nullptr;
+	}
+};
+
+static Coords readCoords(const double* in)
+{
+	return Coords(in[0], in[1], in[2]);
+}
+
+static Colour readColour(const double* in)
+{
+	return Colour(in[0], in[1], in[2]);
+}
+
+bool SceneCache::validMesh(TriangleMesh& mesh)
+{
+	if (mesh.indices.size() % 3 != 0 || (!mesh.normals.empty() && mesh.normals.size() != mesh.positions.size())) return false;
+	for (uint32_t index : mesh.indices)
+	{
+		if (index >= mesh.positions.size()) return false;
+	}
+	return mesh.bvh.validate(mesh.triangleCount());
+}
+
+bool SceneCache::read(const std::string& path, uint64_t hash, Scene& scene)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::unique_ptr<MappedFile> file(new MappedFile(path));
+	if (!file->isOpen()) return false;
+
+	CacheReader reader(*file);
+	CacheHeader header;
+	if (!reader.record(header) || std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+	{
+		std::cout << "\"" << path << "\" isn't a scene cache, rebuilding it" << std::endl;
+		return false;
+	}
+	if (header.version != SCENE_CACHE_VERSION || header.endianness != 0x01020304 || header.vecSize != sizeof(Vec3) ||
+		header.nodeSize != sizeof(BVHNode) || header.wide4Size != sizeof(WideNode<4>) || header.wide8Size != sizeof(WideNode<8>))
+	{
+		std::cout << "Scene cache was written by a different build, rebuilding it" << std::endl;
+		return false;
+	}
+	if (header.hash != hash)
+	{
+		std::cout << "Scene cache is out of date, rebuilding it" << std::endl;
+		return false;
+	}
+
+	// Everything is read into locals first, so a damaged cache leaves the scene untouched
+	std::vector<std::unique_ptr<Shape>> shapes;
+	std::map<std::string, std::unique_ptr<Material>> materials;
+	std::vector<Material*> materialList;
+	std::vector<Object> objects;
+	std::vector<Light> lights;
+
+	size_t nameCount, materialCount;
+	const char* names = reader.array<char>(nameCount);
+	const CacheMaterialRecord* materialRecords = reader.array<CacheMaterialRecord>(materialCount);
+	const char* name = names;
+	for (size_t i = 0; i < materialCount && reader.ok; i++)
+	{
+		size_t left = names + nameCount - name;
+		const char* nameEnd = left > 0 ? (const char*)std::memchr(name, '\0', left) : nullptr;
+		Material* mat = nullptr;
+		switch (materialRecords[i].type)
+		{
+		case CACHE_DIFFUSE: mat = new MatDiffuse(); break;
+		case CACHE_METAL: mat = new MatMetal(); break;
+		case CACHE_METAL_FUZZ: mat = new MatMetalFuzz(materialRecords[i].parameter); break;
+		case CACHE_GLASS: mat = new MatGlass(materialRecords[i].parameter); break;
+		}
+		if (mat == nullptr || nameEnd == nullptr)
+		{
+			delete mat;
+			reader.ok = false;
+			break;
+		}
+		materials[std::string(name, nameEnd)] = std::unique_ptr<Material>(mat);
+		materialList.push_back(mat);
+		name = nameEnd + 1;
+	}
+
+	size_t sphereCount, planeCount;
+	const CacheSphereRecord* spheres = reader.array<CacheSphereRecord>(sphereCount);
+	const CachePlaneRecord* planes = reader.array<CachePlaneRecord>(planeCount);
+	std::vector<Shape*> sphereShapes, planeShapes, meshShapes;
+	for (size_t i = 0; i < sphereCount; i++)
+	{
+		sphereShapes.push_back(new Sphere(readCoords(spheres[i].centre), spheres[i].radius));
+		shapes.push_back(std::unique_ptr<Shape>(sphereShapes.back()));
+	}
+	for (size_t i = 0; i < planeCount; i++)
+	{
+		Coords normal = readCoords(planes[i].normal);
+		if (normal.lengthSquared() == 0.0)
+		{
+			reader.ok = false;
+			break;
+		}
+		planeShapes.push_back(new Plane(readCoords(planes[i].point), normal));
+		shapes.push_back(std::unique_ptr<Shape>(planeShapes.back()));
+	}
+
+	uint64_t meshCount = 0;
+	reader.record(meshCount);
+	for (uint64_t i = 0; i < meshCount && reader.ok; i++)
+	{
+		TriangleMesh* mesh = new TriangleMesh();
+		shapes.push_back(std::unique_ptr<Shape>(mesh));
+		meshShapes.push_back(mesh);
+		reader.record(mesh->box);
+		reader.buffer(mesh->positions);
+		reader.buffer(mesh->normals);
+		reader.buffer(mesh->indices);
+		reader.bvh(mesh->bvh);
+		if (reader.ok && !validMesh(*mesh)) reader.ok = false;
+	}
+
+	size_t objectCount, lightCount;
+	const CacheObjectRecord* objectRecords = reader.array<CacheObjectRecord>(objectCount);
+	for (size_t i = 0; i < objectCount && reader.ok; i++)
+	{
+		const CacheObjectRecord& record = objectRecords[i];
+		std::vector<Shape*>* list = record.shapeType == CACHE_SPHERE ? &sphereShapes :
+			record.shapeType == CACHE_PLANE ? &planeShapes :
+			record.shapeType == CACHE_MESH ? &meshShapes : nullptr;
+		// Only lights go without a material, and they have records of their own
+		if (list == nullptr || record.shape >= list->size() || record.material < 0 || record.material >= (int32_t)materialList.size())
+		{
+			reader.ok = false;
+			break;
+		}
+		objects.push_back(Object((*list)[record.shape], readColour(record.colour), materialList[record.material]));
+	}
+
+	const CacheLightRecord* lightRecords = reader.array<CacheLightRecord>(lightCount);
+	for (size_t i = 0; i < lightCount && reader.ok; i++)
+	{
+		Shape* shape = new Sphere(readCoords(lightRecords[i].centre), lightRecords[i].radius);
+		shapes.push_back(std::unique_ptr<Shape>(shape));
+		lights.push_back(Light{ Object(shape, readColour(lightRecords[i].colour), nullptr), lightRecords[i].intensity });
+	}
+
+	BVH bvh;
+	reader.bvh(bvh);
+	if (reader.ok)
+	{
+		// The scene BVH only holds the objects with bounds, in order, like Accelerator::classify() picks them
+		size_t bounded = 0;
+		for (auto& object : objects)
+		{
+			AABB box;
+			if (object.shape->bounds(box)) bounded++;
+		}
+		reader.ok = bvh.validate(bounded);
+	}
+	if (!reader.ok)
+	{
+		std::cout << "Scene cache \"" << path << "\" is damaged, rebuilding it" << std::endl;
+		return false;
+	}
+
+	scene.shapes = std::move(shapes);
+	scene.materials = std::move(materials);
+	scene.objects = std::move(objects);
+	scene.lights = std::move(lights);
+	scene.accel.reset(new Accelerator(scene.objects, std::move(bvh)));
+	scene.cacheFile = std::move(file);
+
+	double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Loaded scene cache \"" << path << "\" in " << time << "ms" << std::endl;
+	return true;
+}
\ No newline at end of file
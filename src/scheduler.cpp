@@ -0,0 +1,224 @@
+#include <algorithm>
+
+#include "scheduler.hpp"
+
+// Tiles with fewer rows left than this aren't worth splitting
+const int MIN_SPLIT_ROWS = 2;
+// In order, enough bands past the oldest unfinished one are open to give each thread this many tiles
+const int TILES_AHEAD_PER_THREAD = 2;
+
+// A tile's index and rows [y, endY) in one word, 24 bits for the tile and 20 for each row
+const int ROW_BITS = 20;
+const uint64_t ROW_MASK = (1ull << ROW_BITS) - 1;
+
+static uint64_t packRows(int tile, int y, int endY)
+{
+	return ((uint64_t)tile << (2 * ROW_BITS)) | ((uint64_t)y << ROW_BITS) | (uint64_t)endY;
+}
+
+static void unpackRows(uint64_t rows, int& tile, int& y, int& endY)
+{
+	tile = (int)(rows >> (2 * ROW_BITS));
+	y = (int)((rows >> ROW_BITS) & ROW_MASK);
+	endY = (int)(rows & ROW_MASK);
+}
+
+TileScheduler::TileScheduler(int imageWidth, int imageHeight, int blockSize, int threads, bool _inOrder) : inOrder(_inOrder), oldestBand(0)
+{
+	for (int thread = 0; thread < threads; thread++) queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+
+	numBlocksX = (imageWidth + blockSize - 1) / blockSize;
+	int numBlocksY = (imageHeight + blockSize - 1) / blockSize;
+	int numBlocks = numBlocksX * numBlocksY;
+	tilesLeft = numBlocks;
+
+	bandsAhead = std::max(1, (TILES_AHEAD_PER_THREAD * threads + numBlocksX - 1) / numBlocksX);
+	for (int band = 0; band < numBlocksY; band++)
+	{
+		bandRowsLeft.push_back(std::min(blockSize, imageHeight - band * blockSize) * numBlocksX);
+	}
+
+	// Hand out contiguous runs of blocks so each thread starts on its own part of the image
+	for (int block = 0; block < numBlocks; block++)
+	{
+		Tile tile;
+		tile.block = block;
+		tile.x = (block % numBlocksX) * blockSize;
+		tile.y = (block / numBlocksX) * blockSize;
+		tile.width = std::min(blockSize, imageWidth - tile.x);
+		tile.endY = std::min(tile.y + blockSize, imageHeight);
+		tiles.push_back(tile);
+		if (inOrder) queues[block % threads]->tiles.push_back(block);
+		else queues[(int)((long long)block * threads / numBlocks)]->tiles.push_back(block);
+	}
+
+	for (auto& queue : queues)
+	{
+		queue->range = queue->tiles.size();
+		queue->active = packRows(0, 0, 0);
+	}
+}
+
+bool TileScheduler::canStart(int tile)
+{
+	return !inOrder || tiles[tile].block / numBlocksX <= oldestBand + bandsAhead;
+}
+
+void TileScheduler::finishRow(int band)
+{
+	std::lock_guard<std::mutex> lock(bandMutex);
+	if (--bandRowsLeft[band] > 0) return;
+
+	int oldest = oldestBand;
+	while (oldest < (int)bandRowsLeft.size() && bandRowsLeft[oldest] == 0) oldest++;
+	if (oldest == oldestBand) return;
+	oldestBand = oldest;
+	bandFinished.notify_all();
+}
+
+bool TileScheduler::takeRow(WorkerQueue& queue, int& tile, int& row)
+{
+	uint64_t rows = queue.active;
+	while (true)
+	{
+		int y, endY;
+		unpackRows(rows, tile, y, endY);
+		if (y >= endY) return false;
+		// Fails only if a thief split the tile in the meantime, rows then holds what's left
+		if (queue.active.compare_exchange_weak(rows, packRows(tile, y + 1, endY)))
+		{
+			row = y;
+			return true;
+		}
+	}
+}
+
+bool TileScheduler::takeTile(WorkerQueue& queue, bool front, int& tile)
+{
+	uint64_t range = queue.range;
+	while (true)
+	{
+		uint32_t head = (uint32_t)(range >> 32);
+		uint32_t tail = (uint32_t)range;
+		if (head >= tail) return false;
+		tile = queue.tiles[front ? head : tail - 1];
+		// In order the rest of the queue is further down, so too far ahead as well
+		if (!canStart(tile)) return false;
+		uint64_t taken = front ? ((uint64_t)(head + 1) << 32) | tail : ((uint64_t)head << 32) | (tail - 1);
+		if (queue.range.compare_exchange_weak(range, taken))
+		{
+			tilesLeft--;
+			return true;
+		}
+	}
+}
+
+bool TileScheduler::nextRow(int thread, Tile& tile, int& row)
+{
+	if (!inOrder) return findRow(thread, tile, row);
+
+	WorkerQueue& own = *queues[thread];
+	if (own.lastBand != -1) finishRow(own.lastBand);
+	own.lastBand = -1;
+
+	while (true)
+	{
+		int oldest = oldestBand;
+		if (findRow(thread, tile, row))
+		{
+			own.lastBand = tile.block / numBlocksX;
+			return true;
+		}
+		if (tilesLeft == 0) return false;
+
+		// Every tile left is too far ahead and nothing could be split, so wait for the oldest band to finish
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::unique_lock<std::mutex> lock(bandMutex);
+			bandFinished.wait(lock, [&] { return oldestBand != oldest; });
+		}
+		own.idle += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+bool TileScheduler::findRow(int thread, Tile& tile, int& row)
+{
+	WorkerQueue& own = *queues[thread];
+	int index;
+	if (!takeRow(own, index, row))
+	{
+		if (takeTile(own, true, index)) own.active = packRows(index, tiles[index].y, tiles[index].endY);
+		else
+		{
+			auto start = std::chrono::steady_clock::now();
+			uint64_t stolen;
+			bool found = steal(thread, stolen) || split(thread, stolen);
+
+			auto now = std::chrono::steady_clock::now();
+			own.idle += std::chrono::duration<double>(now - start).count();
+			if (!found)
+			{
+				own.finished = now;
+				return false;
+			}
+			// The queue's own rows have run out, so no thief touches active until this is stored
+			own.active = stolen;
+		}
+		if (!takeRow(own, index, row)) return false;
+	}
+	tile = tiles[index];
+	return true;
+}
+
+bool TileScheduler::steal(int thread, uint64_t& stolen)
+{
+	for (int i = 1; i < (int)queues.size(); i++)
+	{
+		int tile;
+		if (!takeTile(*queues[(thread + i) % queues.size()], inOrder, tile)) continue;
+		stolen = packRows(tile, tiles[tile].y, tiles[tile].endY);
+		return true;
+	}
+	return false;
+}
+
+bool TileScheduler::split(int thread, uint64_t& stolen)
+{
+	while (true)
+	{
+		int best = -1;
+		int bestRows = MIN_SPLIT_ROWS - 1;
+		for (int i = 1; i < (int)queues.size(); i++)
+		{
+			int victim = (thread + i) % (int)queues.size();
+			int tile, y, endY;
+			unpackRows(queues[victim]->active, tile, y, endY);
+			if (endY - y > bestRows)
+			{
+				best = victim;
+				bestRows = endY - y;
+			}
+		}
+		if (best == -1) return false;
+
+		// The victim may have moved on since it was measured, so the bottom half is only taken if its rows are unchanged
+		WorkerQueue& victim = *queues[best];
+		uint64_t rows = victim.active;
+		int tile, y, endY;
+		unpackRows(rows, tile, y, endY);
+		if (endY - y < MIN_SPLIT_ROWS) continue;
+		int middle = y + (endY - y + 1) / 2;
+		if (!victim.active.compare_exchange_strong(rows, packRows(tile, y, middle))) continue;
+		stolen = packRows(tile, middle, endY);
+		return true;
+	}
+}
+
+double TileScheduler::idleTime(int thread)
+{
+	std::chrono::steady_clock::time_point frameEnd;
+	for (auto& queue : queues) frameEnd = std::max(frameEnd, queue->finished);
+
+	WorkerQueue& queue = *queues[thread];
+	return queue.idle + std::chrono::duration<double>(frameEnd - queue.finished).count();
+}
\ No newline at end of file
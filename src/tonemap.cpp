@@ -0,0 +1,36 @@
+#include <cmath>
+
+#include "tonemap.hpp"
+
+bool ToneMapper::parseOperator(const std::string& name, Operator& op)
+{
+	if (name == "clamp") op = CLAMP;
+	else if (name == "reinhard") op = REINHARD;
+	else if (name == "aces") op = ACES;
+	else return false;
+	return true;
+}
+
+Colour ToneMapper::apply(const Colour& linear) const
+{
+	return Colour(curve(linear.r), curve(linear.g), curve(linear.b));
+}
+
+double ToneMapper::curve(double value) const
+{
+	value = std::fmax(value * exposure, 0.0);
+	switch (op)
+	{
+	case REINHARD:
+		value = value / (1.0 + value);
+		break;
+	case ACES:
+		value = (value * (2.51 * value + 0.03)) / (value * (2.43 * value + 0.59) + 0.14);
+		break;
+	default:
+		break;
+	}
+	// Square root is exact where pow isn't, so the default gamma gives the same bytes as before
+	value = gamma == 2.0 ? std::sqrt(value) : std::pow(value, 1.0 / gamma);
+	return std::fmin(value, 1.0);
+}
\ No newline at end of file